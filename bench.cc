@@ -0,0 +1,91 @@
+// compares runtime (vprintf) and compile-time (DR_PRINTF) formatting paths.
+// checks first that both paths produce the same text, then times them.
+// run as: ./bench > /dev/null (results are reported on stderr)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include "drecho.hpp"
+
+// default settings
+const bool dr::log_timestamp = true;
+const bool dr::log_branch = true;
+const bool dr::log_branch_scope = true;
+const bool dr::log_text = true;
+const bool dr::log_errno = true;
+const bool dr::log_location = true;
+
+template<typename FN>
+double bench( const char *title, int iterations, const FN &fn ) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for( int i = 0; i < iterations; ++i ) fn( i );
+    double secs = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+    fprintf( stderr, "%-28s %8.1f ns/call\n", title, secs * 1e9 / iterations );
+    return secs;
+}
+
+// dr::format must match snprintf byte for byte
+template<typename FMT, typename... Args>
+bool same( const char *fmt, const Args &... args ) {
+    std::string buf( snprintf( 0, 0, fmt, args... ) + 1, '\0' );
+    buf.resize( snprintf( &buf[0], buf.size(), fmt, args... ) );
+    const std::string &out = dr::format<FMT>( args... );
+    if( out == buf ) return true;
+    fprintf( stderr, "mismatch: \"%s\" printf:\"%s\" dr::format:\"%s\"\n", fmt, buf.c_str(), out.c_str() );
+    return false;
+}
+
+int check( int iterations ) {
+    std::mt19937_64 rng( 1 );
+    int errors = 0;
+    const double fixed[] = { 3.145, 92.235, 0.125, 2.5, -2.5, -0.0, 0.0005, 1e-300, 9007199254740993.0, 1e300, 1.0 / 0.0, -1.0 / 0.0 };
+    for( int i = 0; i < iterations && errors < 10; ++i ) {
+        double f;
+        uint64_t bits = rng();
+        switch( i % 4 ) {
+            break; case 0: f = fixed[ i / 4 % ( sizeof(fixed) / sizeof(fixed[0]) ) ];
+            break; case 1: f = (double)( bits % 100000000 ) / 1000.0;                    // 3 decimals, ties for %.2f
+            break; case 2: memcpy( &f, &bits, sizeof(f) ); if( f != f ) f = 0;           // any bit pattern
+            break; default: f = ( (double)( bits >> 11 ) / ( 1ull << 53 ) - 0.5 ) * 2e6; // uniform
+        }
+        {
+            DR_FMT( "%.2f|%f|%.0f|%.9f" );
+            errors += !same<dr_fmt>( "%.2f|%f|%.0f|%.9f", f, f, f, f );
+        }
+        {
+            int n = (int)bits;
+            DR_FMT( "%d|%hd|%hhd|%u|%hu|%hhu|%x|%hhx|%o" );
+            errors += !same<dr_fmt>( "%d|%hd|%hhd|%u|%hu|%hhu|%x|%hhx|%o", n, n, n, (unsigned)n, (unsigned)n, (unsigned)n, n, n, n );
+        }
+    }
+    fprintf( stderr, "%-28s %s\n", "check vs snprintf", errors ? "FAILED" : "ok" );
+    return errors;
+}
+
+int main() {
+    if( check( 2000000 ) ) return 1;
+
+    const int N = 2000000;
+    const char *name = "request";
+    char buf[256];
+    size_t total = 0;
+
+    double a = bench( "snprintf (format only)", N, [&]( int i ) {
+        total += snprintf( buf, sizeof(buf), "x=%d y=%s z=%.3f id=%x", i, name, i * 0.5, i );
+    } );
+    double b = bench( "dr::format (format only)", N, [&]( int i ) {
+        DR_FMT( "x=%d y=%s z=%.3f id=%x" );
+        total += dr::format<dr_fmt>( i, name, i * 0.5, i ).size();
+    } );
+    double c = bench( "dr::printf (vprintf)", N, [&]( int i ) {
+        dr::printf( DR_GREEN, "x=%d y=%s z=%.3f id=%x\n", i, name, i * 0.5, i );
+    } );
+    double d = bench( "DR_PRINTF (compile-time)", N, [&]( int i ) {
+        DR_PRINTF( DR_GREEN, "x=%d y=%s z=%.3f id=%x\n", i, name, i * 0.5, i );
+    } );
+
+    fprintf( stderr, "format speedup: x%.2f, print speedup: x%.2f (%u)\n", a / b, c / d, (unsigned)( total & 1 ) );
+}
@@ -5,7 +5,7 @@
 
 // @todo .html logs, unconditionally
 // @todo .flat logs on linux, with no ansi codes
-// @todo .ansi logs on windows, and then provide tint.exe viewer in tools/
+// @todo .ansi logs on windows, and then provide tint.exe viewer in tools/ (see tools/drview.cpp for querying)
 
 // @todo hotkeys filtering in runtime (ie, strike 'd'e'b'u'g' keys to filter lines with 'debug' keywords only)
 // @todo clipboard filtering in runtime (ie, copy this 'debug' text to filter lines with 'debug' keywords only)
@@ -15,17 +15,26 @@
 
 #include <math.h>
 #include <errno.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <set>
 #include <map>
+#include <thread>
 
 #if defined(__APPLE__)
 #   include <OpenGL/gl.h>
@@ -53,7 +62,11 @@
 #   define $welse(...)
 #else
 #   include <unistd.h>
+#   include <dirent.h>
 #   include <sys/ioctl.h>
+#   include <sys/socket.h>
+#   include <sys/uio.h>
+#   include <sys/un.h>
 #   define $win(...)
 #   define $welse(...) __VA_ARGS__
 #endif
@@ -127,6 +140,12 @@ namespace
        }
     }
 
+    // ansi codes for mirrored lines, regardless of platform
+    const char *ansi_code( int color ) {
+        static const char *codes[] = { "31", "32", "33", "34", "35", "36", "37", "90", "91", "92", "93", "94", "95", "96", "97" };
+        return color >= 0 && color < DR_TOTAL_COLORS ? codes[ color ] : 0;
+    }
+
     template<typename T>
     std::string to_string( T number ) {
         std::stringstream ss;
@@ -323,10 +342,37 @@ namespace dr
 
 namespace dr
 {
-    int printf( int color, const char* fmt, ... ) {
+    // printed line, mirrored for archives and collectors (see logger)
+    struct mirror {
+        std::string flat, ansi;
+        bool colored = false;
+
+        void append( int color, const std::string &text ) {
+            flat += text;
+            if( colored ) {
+                const char *code = ansi_code( color );
+                if( code ) ansi += "\033[0;", ansi += code, ansi += 'm';
+                ansi += text;
+                if( code ) ansi += "\033[m";
+            }
+        }
+    };
+
+    // when set, printed text is mirrored into this line
+    mirror *&tee() {
+        static thread_local mirror *st = 0;
+        return st;
+    }
+
+    // serializes logged lines. also guards archive and collector instances, which are only used while held
+    std::mutex &output() {
+        static std::mutex st;
+        return st;
+    }
+
+    template<typename FN>
+    int colorize( int color, const FN &fn ) {
         int num;
-        va_list args;
-        va_start(args, fmt);
 
         $win(
             const HANDLE stdout_handle = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -338,7 +384,7 @@ namespace dr
             fflush(stdout);
             SetConsoleTextAttribute(stdout_handle, GetPlatformColorCode(color));
 
-            num = vprintf(fmt, args);
+            num = fn();
 
             fflush(stdout);
             SetConsoleTextAttribute(stdout_handle, previous_attr);
@@ -352,33 +398,156 @@ namespace dr
             // 0x10-0xE7:  6*6*6=216 colors: 16 + 36*r + 6*g + b (0≤r,g,b≤5)
             // 0xE8-0xFF:  grayscale from black to white in 24 steps
             if (color_code) fprintf(stdout, "\033[0;3%sm", color_code);
-            num = vprintf(fmt, args);
+            num = fn();
             ::printf("%s","\033[m");
         )
 
+        return num;
+    }
+
+    int printf( int color, const char* fmt, ... ) {
+        va_list args;
+        va_start(args, fmt);
+        if( mirror *line = tee() ) {
+            va_list copy;
+            va_copy(copy, args);
+            char buf[512];
+            int len = vsnprintf(buf, sizeof(buf), fmt, copy);
+            va_end(copy);
+            if( len >= (int)sizeof(buf) ) {
+                std::string big( len + 1, '\0' );
+                va_copy(copy, args);
+                vsnprintf(&big[0], big.size(), fmt, copy);
+                va_end(copy);
+                line->append( color, big.substr(0, len) );
+            }
+            else if( len > 0 ) line->append( color, std::string(buf, len) );
+        }
+        int num = colorize( color, [&]{ return vprintf(fmt, args); } );
         va_end(args);
         return num;
     }
 
     int print( int color, const std::string &str ) {
-        return dr::printf( color, "%s", str.c_str() );
+        if( mirror *line = tee() ) line->append( color, str );
+        return colorize( color, [&]{ return (int)fwrite( str.data(), 1, str.size(), stdout ); } );
     }
 }
 
+namespace dr
+{
+    namespace fmt
+    {
+        void put_int( std::string &out, long long value ) {
+            unsigned long long u = value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value;
+            if( value < 0 ) out += '-';
+            put_uint( out, u, 10, false );
+        }
+
+        void put_uint( std::string &out, unsigned long long value, unsigned base, bool upper ) {
+            const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+            char buf[24], *end = buf + sizeof(buf), *ptr = end;
+            do {
+                *--ptr = digits[ value % base ];
+                value /= base;
+            } while( value );
+            out.append( ptr, end - ptr );
+        }
+
+        void put_float( std::string &out, double value, int precision ) {
+#ifdef __SIZEOF_INT128__
+            // exact fixed-point fast path: |value| = m * 2^e, so value * 10^p = m * 10^p / 2^-e fits in 128 bits
+            // while |value| < 2^53 and p <= 9; rounded half-to-even on the exact remainder, as printf does.
+            static const unsigned long long pow10[] = { 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull };
+            int e;
+            double mant = frexp( fabs( value ), &e );
+            if( isfinite( value ) && e <= 53 ) {
+                __extension__ typedef unsigned __int128 u128;
+                unsigned long long m = (unsigned long long)ldexp( mant, 53 );
+                unsigned shift = unsigned( 53 - e );
+                u128 n = (u128)m * pow10[ precision ], fixed = 0;
+                if( shift == 0 ) fixed = n;
+                else if( shift < 100 ) {
+                    u128 half = (u128)1 << ( shift - 1 ), rem = n & ( ( half << 1 ) - 1 );
+                    fixed = n >> shift;
+                    if( rem > half || ( rem == half && ( fixed & 1 ) ) ) ++fixed;
+                } // else: n < 2^83, far below half an ulp of the last digit
+                unsigned long long whole = (unsigned long long)( fixed / pow10[ precision ] );
+                unsigned long long frac  = (unsigned long long)( fixed % pow10[ precision ] );
+                if( signbit( value ) ) out += '-';
+                put_uint( out, whole, 10, false );
+                if( precision ) {
+                    char buf[10];
+                    for( int i = precision; i-- > 0; frac /= 10 ) buf[i] = char( '0' + frac % 10 );
+                    out += '.';
+                    out.append( buf, precision );
+                }
+                return;
+            }
+#endif
+            char spec[] = "%.0f";
+            spec[2] = char( '0' + precision );
+            put_spec( out, spec, 4, value );
+        }
+
+        // printf narrows %hd/%hhd arguments (and their unsigned counterparts) before printing
+        template<typename T, typename S, typename C>
+        T narrow( const char *spec, unsigned len, T value ) {
+            if( len < 3 || spec[ len - 2 ] != 'h' ) return value;
+            return len >= 4 && spec[ len - 3 ] == 'h' ? (T)(C)value : (T)(S)value;
+        }
+
+        // copy spec dropping length modifiers, then add ours
+        template<typename T>
+        void put_spec( std::string &out, const char *spec, unsigned len, const char *mod, T value ) {
+            std::string fmt;
+            for( unsigned i = 0; i + 1 < len; ++i ) {
+                if( !strchr( "hlLzjtq", spec[i] ) ) fmt += spec[i];
+            }
+            fmt += mod;
+            fmt += spec[ len - 1 ];
+            char buf[128];
+            int n = snprintf( buf, sizeof(buf), fmt.c_str(), value );
+            if( n < 0 ) return;
+            if( n < (int)sizeof(buf) ) return (void)out.append( buf, n );
+            std::string big( n + 1, '\0' );
+            snprintf( &big[0], big.size(), fmt.c_str(), value );
+            out.append( big.c_str(), n );
+        }
+
+        void put_spec( std::string &out, const char *spec, unsigned len, long long value ) {
+            spec[ len - 1 ] == 'c' ? put_spec( out, spec, len, "", (int)value ) : put_spec( out, spec, len, "ll", narrow<long long, short, signed char>( spec, len, value ) );
+        }
+        void put_spec( std::string &out, const char *spec, unsigned len, unsigned long long value ) {
+            put_spec( out, spec, len, "ll", narrow<unsigned long long, unsigned short, unsigned char>( spec, len, value ) );
+        }
+        void put_spec( std::string &out, const char *spec, unsigned len, double value ) {
+            put_spec( out, spec, len, "", value );
+        }
+        void put_spec( std::string &out, const char *spec, unsigned len, const char *value ) {
+            put_spec( out, spec, len, "", value ? value : "(null)" );
+        }
+        void put_spec( std::string &out, const char *spec, unsigned len, const void *value ) {
+            put_spec( out, spec, len, "", value );
+        }
+    } // ns ::fmt
+}
+
 // -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
 
 namespace dr {
 
     std::string &file() {
-        static std::string st;
+        static thread_local std::string st;
         return st;
     }
-    std::string &prefix() {
-        static std::string st;
+    context &current() {
+        static thread_local context st = { 0, 0, 0 };
         return st;
     }
-    std::string &spent() {
-        static std::string st;
+    // scopes closed by this thread since its last logged line: id and seconds spent
+    std::vector< std::pair<unsigned, double> > &spent() {
+        static thread_local std::vector< std::pair<unsigned, double> > st;
         return st;
     }
     unsigned &color() {
@@ -386,12 +555,86 @@ namespace dr {
         return st;
     }
 
-    scope::scope() : clock(dr::clock()) {
-        prefix().push_back(' ');
+    // per-thread state readable from the crash handler. slots are preallocated, so no allocations are needed to read them
+    enum { MAX_THREADS = 128, MAX_SCOPES = 64 };
+
+    struct thread_state {
+        std::atomic<bool> used;
+        const std::string *line;    // logger line being assembled
+        const context *ctx;
+        struct entry { unsigned id, parent; double clock; } scopes[ MAX_SCOPES ];
+        std::atomic<int> depth;
+    };
+
+    thread_state *threads() {
+        static thread_state st[ MAX_THREADS ];
+        return st;
+    }
+
+    thread_state *this_thread() {
+        static thread_local struct slot {
+            thread_state *st = 0;
+            slot() {
+                for( int i = 0; i < MAX_THREADS && !st; ++i ) {
+                    bool expected = false;
+                    if( threads()[i].used.compare_exchange_strong( expected, true ) ) {
+                        st = &threads()[i];
+                        st->line = 0, st->depth = 0, st->ctx = &current();
+                    }
+                }
+            }
+            ~slot() {
+                if( st ) st->line = 0, st->depth = 0, st->ctx = 0, st->used = false;
+            }
+        } th;
+        return th.st;
+    }
+
+    char *last_error() {
+        static char st[512];
+        return st;
+    }
+
+    unsigned next_id() {
+        static std::atomic<unsigned> ids( 0 );
+        return ++ids;
+    }
+
+    context this_context() {
+        return current();
+    }
+
+    scope::scope() : scope( current() )
+    {}
+    scope::scope( const context &parent ) : clock(dr::clock()), prev(current()) {
+        ctx.id = next_id();
+        ctx.parent = parent.id;
+        ctx.depth = parent.depth + 1;
+        current() = ctx;
+        if( thread_state *th = this_thread() ) {
+            int depth = th->depth;
+            if( depth < MAX_SCOPES ) th->scopes[ depth ] = { ctx.id, ctx.parent, clock };
+            th->depth = depth + 1;
+        }
     }
     scope::~scope() {
-        spent() = std::string("scoped for ") + to_string( dr::clock() - clock ) + "s";
-        prefix().pop_back();
+        if( thread_state *th = this_thread() ) {
+            if( th->depth > 0 ) th->depth--;
+        }
+        // pending until this thread logs again. threads that never log only keep the last few
+        if( dr::log_branch_scope ) {
+            auto &pending = spent();
+            if( pending.size() >= MAX_SCOPES ) pending.erase( pending.begin() );
+            pending.push_back( std::make_pair( ctx.id, dr::clock() - clock ) );
+        }
+        current() = prev;
+    }
+
+    adopt::adopt( const context &ctx ) : prev(current()) {
+        current() = ctx;
+    }
+    adopt::~adopt() {
+        current() = prev;
     }
 }
 
@@ -454,8 +697,1189 @@ namespace dr {
             }
         )
 
-        return err + gl + os;
+        err += gl + os;
+        if( !err.empty() ) {
+            // keep a copy for the crash handler
+            size_t len = err.size() < 511 ? err.size() : 511;
+            memcpy( last_error(), err.c_str(), len );
+            last_error()[ len ] = '\0';
+        }
+        return err;
+    }
+}
+
+// -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+namespace dr {
+    namespace archive {
+        void salvage();
+    }
+
+    // crash handler. only async-signal-safe calls from here: write(), raise(), sigaction() and plain memory reads.
+
+    namespace {
+        const int fatal_signals[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL $welse(, SIGBUS) };
+        enum { NUM_FATAL = sizeof(fatal_signals) / sizeof(fatal_signals[0]) };
+
+#ifdef _WIN32
+        typedef void (*handler_t)( int );
+        handler_t previous[ NUM_FATAL ];
+#else
+        struct sigaction previous[ NUM_FATAL ];
+        char altstack[ 64 * 1024 ];
+#endif
+        bool installed = false;
+
+        struct crash_writer {
+            char buf[ 1024 ];
+            size_t len = 0;
+            ~crash_writer() {
+                flush();
+            }
+            void flush() {
+                for( size_t done = 0; done < len; ) {
+                    int n = (int)$win(_write) $welse(::write)( 1, buf + done, unsigned( len - done ) );
+                    if( n <= 0 ) break;
+                    done += n;
+                }
+                len = 0;
+            }
+            crash_writer &put( const char *str, size_t n ) {
+                for( size_t i = 0; i < n; ++i ) {
+                    if( len == sizeof(buf) ) flush();
+                    buf[ len++ ] = str[i];
+                }
+                return *this;
+            }
+            crash_writer &put( const char *str ) {
+                return put( str, strlen( str ) );
+            }
+            crash_writer &put( unsigned long long v ) {
+                char tmp[24], *p = tmp + sizeof(tmp);
+                do *--p = char( '0' + v % 10 ); while( v /= 10 );
+                return put( p, tmp + sizeof(tmp) - p );
+            }
+            crash_writer &secs( double v ) {
+                unsigned long long ms = v > 0 ? (unsigned long long)( v * 1000 + 0.5 ) : 0;
+                put( ms / 1000 ).put( "." );
+                char frac[3] = { char( '0' + ms / 100 % 10 ), char( '0' + ms / 10 % 10 ), char( '0' + ms % 10 ) };
+                return put( frac, 3 ).put( "s" );
+            }
+        };
+
+        const char *signal_name( int sig ) {
+            switch( sig ) {
+                case SIGSEGV: return "SIGSEGV";
+                case SIGABRT: return "SIGABRT";
+                case SIGFPE:  return "SIGFPE";
+                case SIGILL:  return "SIGILL";
+                $welse( case SIGBUS: return "SIGBUS"; )
+                default:      return "signal";
+            }
+        }
+
+        // write pending stdio buffers directly. only glibc exposes them; elsewhere they are lost
+        void flush_stdio( FILE *fp, int fd ) {
+#if defined(__GLIBC__)
+            const char *base = fp->_IO_write_base, *ptr = fp->_IO_write_ptr;
+            for( ; base && ptr > base; ) {
+                int n = (int)::write( fd, base, ptr - base );
+                if( n <= 0 ) break;
+                base += n;
+            }
+            fp->_IO_write_ptr = fp->_IO_write_base;
+#endif
+        }
+
+        void dump( int sig ) {
+            flush_stdio( stdout, 1 );
+            flush_stdio( stderr, 2 );
+            archive::salvage();
+
+            crash_writer w;
+            double now = dr::clock();
+            w.put( "\n*** DrEcho caught " ).put( signal_name( sig ) ).put( " (signal " ).put( (unsigned long long)sig ).put( ")\n" );
+
+            for( int t = 0; t < MAX_THREADS; ++t ) {
+                const thread_state &th = threads()[t];
+                if( !th.used ) continue;
+                if( th.line && th.line->size() ) {
+                    w.put( "*** thread " ).put( (unsigned long long)t ).put( ": unfinished line: " ).put( th.line->data(), th.line->size() ).put( "\n" );
+                }
+                int depth = th.depth;
+                if( !depth && th.ctx && th.ctx->id ) {
+                    w.put( "*** thread " ).put( (unsigned long long)t ).put( ": in adopted scope #" ).put( (unsigned long long)th.ctx->id ).put( "\n" );
+                }
+                for( int d = ( depth < MAX_SCOPES ? depth : MAX_SCOPES ); d-- > 0; ) {
+                    const thread_state::entry &e = th.scopes[d];
+                    w.put( "*** thread " ).put( (unsigned long long)t ).put( ": scope #" ).put( (unsigned long long)e.id );
+                    if( e.parent ) w.put( " <#" ).put( (unsigned long long)e.parent );
+                    w.put( ", " ).secs( now - e.clock ).put( " elapsed\n" );
+                }
+            }
+
+            if( last_error()[0] ) {
+                w.put( "*** last error: " ).put( last_error() ).put( "\n" );
+            }
+        }
+
+        void chain( int sig, int slot $welse(, siginfo_t *info, void *uctx) ) {
+#ifdef _WIN32
+            handler_t prev = previous[ slot ];
+            signal( sig, prev );
+            if( prev != SIG_DFL && prev != SIG_IGN ) prev( sig );
+            else raise( sig );
+#else
+            const struct sigaction &prev = previous[ slot ];
+            sigaction( sig, &prev, 0 );
+            if( ( prev.sa_flags & SA_SIGINFO ) && prev.sa_sigaction ) prev.sa_sigaction( sig, info, uctx );
+            else if( prev.sa_handler != SIG_DFL && prev.sa_handler != SIG_IGN ) prev.sa_handler( sig );
+            else raise( sig ); // delivered with default action once we return
+#endif
+        }
+
+        void on_crash( int sig $welse(, siginfo_t *info, void *uctx) ) {
+            static std::atomic<bool> entered( false );
+            if( !entered.exchange( true ) ) dump( sig );
+
+            for( int i = 0; i < NUM_FATAL; ++i ) {
+                if( fatal_signals[i] == sig ) return chain( sig, i $welse(, info, uctx) );
+            }
+        }
+    }
+
+    bool crash_handler( bool enable ) {
+        if( enable == installed ) return false;
+
+        if( enable ) {
+            // touch lazily initialized statics now rather than from the handler
+            dr::clock();
+            this_thread();
+        }
+
+#ifdef _WIN32
+        for( int i = 0; i < NUM_FATAL; ++i ) {
+            if( enable ) previous[i] = signal( fatal_signals[i], on_crash );
+            else signal( fatal_signals[i], previous[i] );
+        }
+#else
+        if( enable ) {
+            // alternate stack for the calling thread, so stack overflows can be reported too
+            stack_t ss = {};
+            ss.ss_sp = altstack;
+            ss.ss_size = sizeof(altstack);
+            sigaltstack( &ss, 0 );
+
+            struct sigaction sa = {};
+            sa.sa_sigaction = on_crash;
+            sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+            sigemptyset( &sa.sa_mask );
+            for( int i = 0; i < NUM_FATAL; ++i ) sigaction( fatal_signals[i], &sa, &previous[i] );
+        } else {
+            for( int i = 0; i < NUM_FATAL; ++i ) sigaction( fatal_signals[i], &previous[i], 0 );
+        }
+#endif
+
+        installed = enable;
+        return true;
+    }
+}
+
+// -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+namespace dr {
+namespace archive {
+
+    // codec: lz77 over a 64KiB window. block is a list of sequences:
+    // [token: literals(4) | match-4(4)] [extra literal len] [literals] [offset:u16] [extra match len]
+    // nibbles set to 15 continue on extra bytes (255,255,...,n). last sequence has literals only.
+
+    namespace {
+        enum { MIN_MATCH = 4, HASH_BITS = 14, WINDOW = 65535 };
+
+        inline unsigned read32( const unsigned char *p ) {
+            return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( unsigned( p[3] ) << 24 );
+        }
+        inline void put_len( std::string &out, size_t len ) {
+            for( ; len >= 255; len -= 255 ) out += char( 255 );
+            out += char( len );
+        }
+        inline bool get_len( const unsigned char *&ip, const unsigned char *end, size_t &len ) {
+            for( unsigned char b = 255; b == 255; len += b ) {
+                if( ip >= end ) return false;
+                b = *ip++;
+            }
+            return true;
+        }
+        void sequence( std::string &out, const unsigned char *lit, size_t lits, size_t offset, size_t match ) {
+            size_t ml = match ? match - MIN_MATCH : 0;
+            out += char( ( ( lits < 15 ? lits : 15 ) << 4 ) | ( ml < 15 ? ml : 15 ) );
+            if( lits >= 15 ) put_len( out, lits - 15 );
+            out.append( (const char *)lit, lits );
+            if( match ) {
+                out += char( offset & 0xff );
+                out += char( offset >> 8 );
+                if( ml >= 15 ) put_len( out, ml - 15 );
+            }
+        }
+    }
+
+    void compress( const char *src, size_t len, std::string &out ) {
+        static thread_local std::vector<size_t> table;
+        table.assign( 1 << HASH_BITS, ~size_t(0) );
+
+        const unsigned char *in = (const unsigned char *)src;
+        size_t anchor = 0;
+        for( size_t i = 0; i + MIN_MATCH <= len; ) {
+            unsigned seq = read32( in + i );
+            size_t &slot = table[ ( seq * 2654435761u ) >> ( 32 - HASH_BITS ) ];
+            size_t ref = slot;
+            slot = i;
+            if( ref != ~size_t(0) && i - ref <= WINDOW && read32( in + ref ) == seq ) {
+                size_t m = MIN_MATCH;
+                while( i + m < len && in[ ref + m ] == in[ i + m ] ) ++m;
+                sequence( out, in + anchor, i - anchor, i - ref, m );
+                i += m;
+                anchor = i;
+            } else {
+                ++i;
+            }
+        }
+        sequence( out, in + anchor, len - anchor, 0, 0 );
+    }
+
+    bool decompress( const char *src, size_t len, char *dst, size_t raw ) {
+        const unsigned char *ip = (const unsigned char *)src, *iend = ip + len;
+        unsigned char *op = (unsigned char *)dst, *oend = op + raw;
+        for( ;; ) {
+            if( ip >= iend ) return false;
+            unsigned token = *ip++;
+            size_t lits = token >> 4, match = token & 15;
+            if( lits == 15 && !get_len( ip, iend, lits ) ) return false;
+            if( lits > size_t( iend - ip ) || lits > size_t( oend - op ) ) return false;
+            memcpy( op, ip, lits );
+            op += lits, ip += lits;
+            if( op == oend ) return ip == iend;
+            if( iend - ip < 2 ) return false;
+            size_t offset = ip[0] | ( ip[1] << 8 );
+            ip += 2;
+            if( match == 15 && !get_len( ip, iend, match ) ) return false;
+            match += MIN_MATCH;
+            if( !offset || offset > size_t( op - (unsigned char *)dst ) || match > size_t( oend - op ) ) return false;
+            // byte by byte, as matches may overlap
+            for( const unsigned char *ref = op - offset; match--; ) *op++ = *ref++;
+        }
+    }
+
+    // -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+    // segment file: "DRZ1" magic, then blocks of [raw size:u32][packed size:u32 (0 if stored)][payload]
+
+    namespace {
+        const char magic[] = "DRZ1";
+
+        void put32( FILE *fp, size_t v ) {
+            unsigned char b[4] = { (unsigned char)v, (unsigned char)( v >> 8 ), (unsigned char)( v >> 16 ), (unsigned char)( v >> 24 ) };
+            fwrite( b, 1, 4, fp );
+        }
+        bool get32( FILE *fp, size_t &v ) {
+            unsigned char b[4];
+            if( fread( b, 1, 4, fp ) != 4 ) return false;
+            v = b[0] | ( b[1] << 8 ) | ( b[2] << 16 ) | ( size_t( b[3] ) << 24 );
+            return true;
+        }
+
+        double thread_cpu() {
+            $win(
+                FILETIME creation, exit, kernel, user;
+                if( !GetThreadTimes( GetCurrentThread(), &creation, &exit, &kernel, &user ) ) return 0;
+                return ( ( (unsigned long long)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime ) +
+                         ( (unsigned long long)user.dwHighDateTime << 32 | user.dwLowDateTime ) ) / 1e7;
+            )
+            $welse(
+                struct timespec ts;
+                if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) ) return 0;
+                return ts.tv_sec + ts.tv_nsec / 1e9;
+            )
+        }
+
+        struct archiver {
+            std::mutex mutex;
+            std::condition_variable wake, drained;
+            std::deque<std::string> queue;
+            std::string pending;
+            std::thread worker;
+            bool running = false, ansi = false;
+            std::string basename;
+            size_t segment_size = 0, block_size = 0;
+            unsigned index = 0;         // of next segment
+            FILE *fp = 0;
+            volatile int fd = -1;       // of fp, for the crash handler
+            size_t segment_raw = 0;
+            stats_t st = {};
+
+            ~archiver() {
+                stop();
+                if( fp ) fclose( fp );
+            }
+
+            // resume numbering after the highest existing segment, so reopening never truncates older archives
+            void resume() {
+                std::string dir = ".", prefix = basename, suffix = ansi ? ".ansi.drz" : ".flat.drz";
+                size_t slash = basename.find_last_of( "/\\" );
+                if( slash != std::string::npos ) {
+                    dir = basename.substr( 0, slash ? slash : 1 );
+                    prefix = basename.substr( slash + 1 );
+                }
+                auto consider = [&]( const char *name ) {
+                    size_t len = strlen( name ), digits = len - prefix.size() - 1 - suffix.size();
+                    if( len < prefix.size() + 1 + 4 + suffix.size() ) return;
+                    if( memcmp( name, prefix.data(), prefix.size() ) || name[ prefix.size() ] != '.' ) return;
+                    if( memcmp( name + len - suffix.size(), suffix.data(), suffix.size() ) ) return;
+                    const char *num = name + prefix.size() + 1;
+                    for( size_t i = 0; i < digits; ++i ) if( num[i] < '0' || num[i] > '9' ) return;
+                    unsigned n = (unsigned)strtoul( num, 0, 10 );
+                    if( n >= index ) index = n + 1;
+                };
+                $win(
+                    WIN32_FIND_DATAA found;
+                    HANDLE h = FindFirstFileA( ( basename + ".*" + suffix ).c_str(), &found );
+                    if( h != INVALID_HANDLE_VALUE ) {
+                        do consider( found.cFileName ); while( FindNextFileA( h, &found ) );
+                        FindClose( h );
+                    }
+                )
+                $welse(
+                    if( DIR *d = opendir( dir.c_str() ) ) {
+                        while( struct dirent *e = readdir( d ) ) consider( e->d_name );
+                        closedir( d );
+                    }
+                )
+            }
+
+            bool next_segment() {
+                if( fp ) fclose( fp ), fp = 0;
+                char name[32];
+                sprintf( name, ".%04u.%s.drz", index, ansi ? "ansi" : "flat" );
+                fd = -1;
+                fp = fopen( ( basename + name ).c_str(), "wb" );
+                if( !fp ) return false;
+                fwrite( magic, 1, 4, fp );
+                fflush( fp );
+                fd = $win(_fileno) $welse(fileno)( fp );
+                index++;
+                segment_raw = 0;
+                std::lock_guard<std::mutex> lock( mutex );
+                st.segments++;
+                return true;
+            }
+
+            void start() {
+                running = true;
+                worker = std::thread( [this] { run(); } );
+            }
+
+            void stop() {
+                {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    if( !running ) return;
+                    if( !pending.empty() ) queue.push_back( std::move( pending ) ), pending.clear();
+                    running = false;
+                }
+                wake.notify_one();
+                worker.join();
+            }
+
+            // called by logging threads. blocks only if background thread falls far behind
+            void append( const std::string &line ) {
+                std::unique_lock<std::mutex> lock( mutex );
+                if( !running ) return;
+                pending += line;
+                if( pending.size() >= block_size ) {
+                    drained.wait( lock, [this] { return queue.size() < 64 || !running; } );
+                    queue.push_back( std::move( pending ) );
+                    pending.clear();
+                    pending.reserve( block_size + 4096 );
+                    lock.unlock();
+                    wake.notify_one();
+                }
+            }
+
+            void run() {
+                double cpu0 = thread_cpu();
+                std::string packed;
+
+                for( ;; ) {
+                    std::string block;
+                    {
+                        std::unique_lock<std::mutex> lock( mutex );
+                        // flush partial blocks after a second of inactivity
+                        if( !wake.wait_for( lock, std::chrono::seconds( 1 ), [this] { return !queue.empty() || !running; } ) ) {
+                            if( pending.empty() ) continue;
+                            queue.push_back( std::move( pending ) );
+                            pending.clear();
+                        }
+                        if( queue.empty() ) break; // stopped and drained
+                        block = std::move( queue.front() );
+                        queue.pop_front();
+                    }
+                    drained.notify_all();
+
+                    if( ( !fp || segment_raw >= segment_size ) && !next_segment() ) {
+                        std::lock_guard<std::mutex> lock( mutex );
+                        st.dropped++;
+                        continue;
+                    }
+
+                    packed.clear();
+                    compress( block.data(), block.size(), packed );
+                    bool stored = packed.size() >= block.size();
+                    put32( fp, block.size() );
+                    put32( fp, stored ? 0 : packed.size() );
+                    if( stored ) fwrite( block.data(), 1, block.size(), fp );
+                    else fwrite( packed.data(), 1, packed.size(), fp );
+                    bool written = !fflush( fp ) && !ferror( fp );
+                    segment_raw += block.size();
+
+                    std::lock_guard<std::mutex> lock( mutex );
+                    if( !written ) {
+                        st.dropped++;
+                        continue;
+                    }
+                    st.raw += block.size();
+                    st.packed += 8 + ( stored ? block.size() : packed.size() );
+                    st.blocks++;
+                    st.cpu = thread_cpu() - cpu0;
+                }
+            }
+        };
+
+        archiver *&instance() {
+            static archiver *st = 0;
+            return st;
+        }
+
+        stats_t &last_stats() {
+            static stats_t st = {};
+            return st;
+        }
+    }
+
+    bool open( const std::string &basename, bool ansi, size_t segment_size, size_t block_size ) {
+        dr::output(); // constructed before closer below, so it outlives it
+        static struct closer { ~closer() { archive::close(); } } at_exit;
+        close();
+        archiver *a = new archiver;
+        a->basename = basename;
+        a->ansi = ansi;
+        a->segment_size = segment_size ? segment_size : 1;
+        a->block_size = block_size ? block_size : 1;
+        a->pending.reserve( a->block_size + 4096 );
+        a->resume();
+        if( !a->next_segment() ) {
+            last_stats() = a->st;
+            delete a;
+            return false;
+        }
+        a->start();
+        std::lock_guard<std::mutex> lock( dr::output() );
+        instance() = a;
+        return true;
+    }
+
+    void close() {
+        archiver *a;
+        {
+            // wait for any line being logged, so no logging thread is left holding the instance
+            std::lock_guard<std::mutex> lock( dr::output() );
+            a = instance();
+            instance() = 0;
+        }
+        if( a ) {
+            a->stop();
+            last_stats() = a->st;
+            delete a;
+        }
+    }
+
+    stats_t stats() {
+        std::lock_guard<std::mutex> lock( dr::output() );
+        stats_t out = last_stats();
+        if( archiver *a = instance() ) {
+            std::lock_guard<std::mutex> lock( a->mutex );
+            out = a->st;
+        }
+        return out;
+    }
+
+    bool read( const std::string &pathfile, const std::function<void( const char *data, size_t len )> &fn ) {
+        FILE *fp = fopen( pathfile.c_str(), "rb" );
+        if( !fp ) return false;
+
+        char head[4];
+        bool ok = fread( head, 1, 4, fp ) == 4 && !memcmp( head, magic, 4 );
+        std::string packed, raw;
+        size_t raw_len, packed_len;
+        while( ok && get32( fp, raw_len ) ) {
+            ok = get32( fp, packed_len );
+            if( !ok ) break;
+            raw.resize( raw_len );
+            if( !packed_len ) {
+                ok = fread( &raw[0], 1, raw_len, fp ) == raw_len;
+            } else {
+                packed.resize( packed_len );
+                ok = fread( &packed[0], 1, packed_len, fp ) == packed_len && decompress( &packed[0], packed_len, &raw[0], raw_len );
+            }
+            if( ok ) fn( raw.data(), raw.size() );
+        }
+
+        fclose( fp );
+        return ok;
+    }
+
+    // crash handler hook: appends pending and queued lines as stored blocks, with write() on the segment fd.
+    // no locks can be taken, so this is best effort: the block being compressed at the time is lost.
+    void salvage() {
+        archiver *a = instance();
+        int fd = a ? a->fd : -1;
+        if( fd < 0 ) return;
+        auto put = [&]( const char *data, size_t len ) {
+            while( len ) {
+                int n = (int)$win(_write) $welse(::write)( fd, data, unsigned( len ) );
+                if( n <= 0 ) return;
+                data += n, len -= n;
+            }
+        };
+        auto stored = [&]( const std::string &block ) {
+            size_t len = block.size();
+            if( !len ) return;
+            unsigned char head[8] = { (unsigned char)len, (unsigned char)( len >> 8 ), (unsigned char)( len >> 16 ), (unsigned char)( len >> 24 ) };
+            put( (const char *)head, 8 );
+            put( block.data(), len );
+        };
+        for( const std::string &block : a->queue ) stored( block );
+        stored( a->pending );
+    }
+
+    // logger hooks, called with dr::output() held
+    bool enabled() {
+        return instance() != 0;
     }
+    bool colored() {
+        return instance() && instance()->ansi;
+    }
+    void write( const std::string &line ) {
+        if( archiver *a = instance() ) a->append( line );
+    }
+} // ns ::archive
+}
+
+// -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+namespace dr {
+namespace collector {
+
+    // lines are packed into datagrams of up to datagram_size bytes; full datagrams are sent in batches
+    // with a single sendmmsg() call. sends never block: whatever the collector cannot take is dropped and counted.
+    // a background thread sends partial batches once their oldest line has waited for max_delay seconds.
+
+    namespace {
+        struct sender {
+            std::mutex mutex;
+            int fd = -1;
+            bool structured = false;
+            size_t datagram_size = 0, batch = 0;
+            std::vector<std::string> datagrams;     // [0, used) are pending; last one may be partially filled
+            std::vector<unsigned> lines;            // lines in each pending datagram
+            size_t used = 0;
+            double oldest = 0;
+            stats_t st = {};
+            std::condition_variable wake;
+            std::thread flusher;
+            bool running = false;
+            const double max_delay = 0.1;
+
+            ~sender() {
+                stop();
+                std::lock_guard<std::mutex> lock( mutex );
+                send();
+                $welse( if( fd >= 0 ) ::close( fd ); )
+            }
+
+            void start() {
+                running = true;
+                flusher = std::thread( [this] { run(); } );
+            }
+
+            void stop() {
+                {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    if( !running ) return;
+                    running = false;
+                }
+                wake.notify_one();
+                flusher.join();
+            }
+
+            // sends lines left behind by a process that went quiet
+            void run() {
+                std::unique_lock<std::mutex> lock( mutex );
+                while( running ) {
+                    wake.wait_for( lock, std::chrono::duration<double>( max_delay / 2 ) );
+                    if( used && dr::clock() - oldest >= max_delay ) send();
+                }
+            }
+
+            void drop( size_t from, size_t to ) {
+                for( size_t i = from; i < to; ++i ) {
+                    st.dropped_datagrams++;
+                    st.dropped_lines += lines[i];
+                }
+            }
+
+            void send() {
+                if( !used ) return;
+#if defined(_WIN32)
+                drop( 0, used );
+#elif defined(__linux__)
+                std::vector<struct mmsghdr> msgs( used );
+                std::vector<struct iovec> iov( used );
+                for( size_t i = 0; i < used; ++i ) {
+                    iov[i].iov_base = &datagrams[i][0];
+                    iov[i].iov_len = datagrams[i].size();
+                    msgs[i] = {};
+                    msgs[i].msg_hdr.msg_iov = &iov[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                for( size_t sent = 0; sent < used; ) {
+                    int n = sendmmsg( fd, &msgs[sent], unsigned( used - sent ), MSG_DONTWAIT );
+                    st.syscalls++;
+                    if( n < 0 && errno == EINTR ) continue;
+                    if( n < 0 && errno == EMSGSIZE ) { drop( sent, sent + 1 ); sent++; continue; } // this one only
+                    if( n <= 0 ) { drop( sent, used ); break; }
+                    for( int i = 0; i < n; ++i ) st.lines += lines[ sent + i ];
+                    st.datagrams += n;
+                    sent += n;
+                }
+#else
+                for( size_t i = 0; i < used; ++i ) {
+                    ssize_t n;
+                    do n = ::send( fd, datagrams[i].data(), datagrams[i].size(), MSG_DONTWAIT ), st.syscalls++;
+                    while( n < 0 && errno == EINTR );
+                    if( n < 0 && errno == EMSGSIZE ) { drop( i, i + 1 ); continue; }
+                    if( n < 0 ) { drop( i, used ); break; }
+                    st.lines += lines[i];
+                    st.datagrams++;
+                }
+#endif
+                for( size_t i = 0; i < used; ++i ) datagrams[i].clear();
+                used = 0;
+            }
+
+            void write( const std::string &line_ ) {
+                // a line never spans datagrams: longer ones are cut, keeping their newline
+                const std::string *line = &line_;
+                std::string cut;
+                if( line_.size() > datagram_size ) {
+                    cut.assign( line_, 0, datagram_size - 1 );
+                    cut += '\n';
+                    line = &cut;
+                }
+                std::lock_guard<std::mutex> lock( mutex );
+                if( line == &cut ) st.truncated_lines++;
+                if( !used || datagrams[ used - 1 ].size() + line->size() > datagram_size ) {
+                    if( used == batch ) send();
+                    if( !used ) oldest = dr::clock();
+                    used++;
+                    lines[ used - 1 ] = 0;
+                }
+                datagrams[ used - 1 ] += *line;
+                lines[ used - 1 ]++;
+                // batches go out once all datagrams are full (above), or when lines have been waiting for a while
+                if( dr::clock() - oldest >= max_delay ) send();
+            }
+        };
+
+        sender *&instance() {
+            static sender *st = 0;
+            return st;
+        }
+
+        stats_t &last_stats() {
+            static stats_t st = {};
+            return st;
+        }
+    }
+
+    bool open( const std::string &path, bool seqpacket, bool structured, size_t datagram_size, size_t batch ) {
+        dr::output(); // constructed before closer below, so it outlives it
+        static struct closer { ~closer() { collector::close(); } } at_exit;
+        close();
+#ifdef _WIN32
+        return false;
+#else
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if( path.size() >= sizeof(addr.sun_path) ) return false;
+        memcpy( addr.sun_path, path.c_str(), path.size() );
+
+        int fd = socket( AF_UNIX, seqpacket ? SOCK_SEQPACKET : SOCK_DGRAM, 0 );
+        if( fd < 0 ) return false;
+        if( connect( fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0 ) {
+            ::close( fd );
+            return false;
+        }
+
+        sender *s = new sender;
+        s->fd = fd;
+        s->structured = structured;
+        s->datagram_size = datagram_size ? datagram_size : 1;
+        s->batch = batch ? batch : 1;
+        s->datagrams.resize( s->batch );
+        s->lines.resize( s->batch );
+        for( auto &dg : s->datagrams ) dg.reserve( s->datagram_size );
+        s->start();
+        std::lock_guard<std::mutex> lock( dr::output() );
+        instance() = s;
+        return true;
+#endif
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock( dr::output() );
+        if( sender *s = instance() ) {
+            std::lock_guard<std::mutex> lock( s->mutex );
+            s->send();
+        }
+    }
+
+    void close() {
+        sender *s;
+        {
+            // wait for any line being logged, so no logging thread is left holding the instance
+            std::lock_guard<std::mutex> lock( dr::output() );
+            s = instance();
+            instance() = 0;
+        }
+        if( s ) {
+            s->stop();
+            {
+                std::lock_guard<std::mutex> lock( s->mutex );
+                s->send();
+                last_stats() = s->st;
+            }
+            delete s;
+        }
+    }
+
+    stats_t stats() {
+        std::lock_guard<std::mutex> lock( dr::output() );
+        stats_t out = last_stats();
+        if( sender *s = instance() ) {
+            std::lock_guard<std::mutex> lock( s->mutex );
+            out = s->st;
+        }
+        return out;
+    }
+
+    // logger hooks, called with dr::output() held
+    bool enabled() {
+        return instance() != 0;
+    }
+    bool structured() {
+        return instance() && instance()->structured;
+    }
+    void write( const std::string &line ) {
+        if( sender *s = instance() ) s->write( line );
+    }
+
+    // structured fields are tab-separated, one record per line: escape \t \n and \\ within fields
+    std::string escape( const std::string &field ) {
+        if( field.find_first_of( "\t\n\\" ) == std::string::npos ) return field;
+        std::string out;
+        out.reserve( field.size() + 8 );
+        for( char c : field ) {
+            /**/ if( c == '\t' ) out += "\\t";
+            else if( c == '\n' ) out += "\\n";
+            else if( c == '\\' ) out += "\\\\";
+            else out += c;
+        }
+        return out;
+    }
+} // ns ::collector
+}
+
+// -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+namespace dr {
+    std::string lowercase( std::string text );
+
+namespace dfa {
+
+    // highlight rules are compiled into a single dfa: pattern -> thompson nfa -> subset construction.
+    // bytes are grouped in equivalence classes to keep the transition table small.
+    // patterns are case-insensitive and only match whole tokens (see machine::paint).
+    // compile() fails past MAX_STATES; callers then compile patterns alone and look keywords up by token.
+
+    enum { MAX_STATES = 1 << 15 };
+
+    struct machine {
+        int classes[256] = {}, ncls = 0;
+        bool delims[256] = {};
+        std::vector<int> table;         // [state * ncls + class] -> state, or -1
+        std::vector<int> accept;        // color for accepting states, or -1
+
+        bool compile( const std::vector< std::pair<std::string, int> > &rules, const char *delimiters );
+
+        // calls fn( color, begin, end ) over consecutive runs of line. matches start and end on token
+        // boundaries (between two chars when either is a delimiter); leftmost match wins, then longest,
+        // then earliest rule. whole tokens found in `keywords` (lowercase, if not compiled in) win ties too.
+        // unmatched runs are reported as DR_DEFAULT.
+        // single left-to-right pass: every token start opens a run, and all live runs step together on each
+        // byte. runs reaching the same dfa state share their future, so only the leftmost one is kept: work
+        // per byte is bounded by the number of dfa states, whatever the patterns and the line look like.
+        template<typename FN>
+        void paint( const std::string &line, const std::map<std::string, DR_COLOR> *keywords, const FN &fn ) const {
+            const unsigned char *s = (const unsigned char *)line.data();
+            const size_t n = line.size();
+            auto boundary = [&]( size_t i ) {
+                return i == 0 || i == n || delims[ s[i - 1] ] || delims[ s[i] ];
+            };
+            runs.clear();
+            live.clear();
+            size_t head = 0, plain = 0;
+            for( size_t k = 0; k <= n; ++k ) {
+                if( k == n ) {
+                    for( size_t r : live ) runs[r].state = -1;
+                    live.clear();
+                } else if( k >= plain && boundary( k ) ) {
+                    run r = { k, 0, table.empty() ? -1 : 0, -1 };
+                    if( keywords && !keywords->empty() ) {
+                        size_t e = k;
+                        do ++e; while( e < n && !boundary( e ) );
+                        key.assign( line, k, e - k );
+                        for( auto &ch : key ) if( ch >= 'A' && ch <= 'Z' ) ch = ( ch - 'A' ) + 'a';
+                        auto found = keywords->find( key );
+                        if( found != keywords->end() ) r.end = e, r.color = found->second;
+                    }
+                    // most tokens cannot start a match: skip them before they cost a run
+                    if( r.state >= 0 && table[ classes[ s[k] ] ] < 0 ) r.state = -1;
+                    if( r.state >= 0 ) live.push_back( runs.size() );
+                    if( r.state >= 0 || r.end ) runs.push_back( r );
+                }
+
+                // leftmost run decides once it is dead: commit its match, or give way to the next one
+                while( head < runs.size() && runs[head].state < 0 ) {
+                    const run r = runs[ head++ ];
+                    if( !r.end ) continue;
+                    if( plain < r.start ) fn( DR_DEFAULT, plain, r.start );
+                    fn( r.color, r.start, r.end );
+                    plain = r.end;
+                    while( head < runs.size() && runs[head].start < r.end ) runs[ head++ ].state = -1;
+                }
+                if( k == n ) break;
+
+                // step live runs, merging those landing on the same state into the leftmost one
+                if( !++tick ) std::fill( seen.begin(), seen.end(), 0 ), tick = 1;
+                size_t kept = 0;
+                for( size_t r : live ) {
+                    run &ru = runs[r];
+                    if( r < head || ru.state < 0 ) continue;
+                    int st = table[ ru.state * ncls + classes[ s[k] ] ];
+                    if( st >= 0 && seen[st] == tick ) st = -1;
+                    ru.state = st;
+                    if( st < 0 ) continue;
+                    seen[st] = tick;
+                    if( accept[st] >= 0 && k + 1 > ru.end && boundary( k + 1 ) ) ru.end = k + 1, ru.color = accept[st];
+                    live[ kept++ ] = r;
+                }
+                live.resize( kept );
+            }
+            if( plain < n ) fn( DR_DEFAULT, plain, n );
+        }
+
+    private:
+        struct run { size_t start, end; int state, color; };
+        mutable std::vector<run> runs;          // scratch space for paint(), which callers serialize
+        mutable std::vector<size_t> live;
+        mutable std::vector<unsigned> seen;     // per state, tick of last step that reached it
+        mutable unsigned tick = 0;
+        mutable std::string key;
+    };
+
+    namespace {
+        typedef std::bitset<256> charset;
+
+        struct nfa {
+            struct node {
+                charset set;            // byte edge to `out`, if set is not empty
+                int out = -1;
+                std::vector<int> eps;
+                int accept = -1;        // rule index
+            };
+            std::vector<node> nodes;
+
+            int add() {
+                nodes.push_back( node() );
+                return int( nodes.size() ) - 1;
+            }
+        };
+
+        struct frag { int in, out; };
+
+        charset fold( charset set ) {
+            for( int c = 'a'; c <= 'z'; ++c ) {
+                if( set[c] || set[c - 'a' + 'A'] ) set[c] = set[c - 'a' + 'A'] = true;
+            }
+            return set;
+        }
+
+        struct parser {
+            nfa &n;
+            const char *p;
+            bool ok = true;
+
+            parser( nfa &n, const char *p ) : n(n), p(p)
+            {}
+
+            frag edge( const charset &set ) {
+                frag f = { n.add(), n.add() };
+                n.nodes[ f.in ].set = fold( set );
+                n.nodes[ f.in ].out = f.out;
+                return f;
+            }
+            frag empty() {
+                int s = n.add();
+                return { s, s };
+            }
+
+            bool escape( char c, charset &set ) {
+                switch( c ) {
+                    case 'd': for( int i = '0'; i <= '9'; ++i ) set[i] = true; return true;
+                    case 'x': for( int i = '0'; i <= '9'; ++i ) set[i] = true; for( int i = 'a'; i <= 'f'; ++i ) set[i] = true; return true;
+                    case 'w': for( int i = 0; i < 256; ++i ) set[i] = set[i] || ( i >= '0' && i <= '9' ) || ( i >= 'a' && i <= 'z' ) || ( i >= 'A' && i <= 'Z' ) || i == '_'; return true;
+                    case 's': set[' '] = set['\t'] = true; return true;
+                    case '\0': return false;
+                    default: set[ (unsigned char)c ] = true; return true;
+                }
+            }
+
+            frag set() {
+                // p is past '['
+                charset set;
+                bool negate = *p == '^';
+                if( negate ) ++p;
+                for( bool first = true; *p && ( first || *p != ']' ); first = false ) {
+                    if( *p == '\\' ) {
+                        if( !escape( p[1], set ) ) return ok = false, empty();
+                        p += 2;
+                    } else if( p[1] == '-' && p[2] && p[2] != ']' ) {
+                        for( int c = (unsigned char)p[0]; c <= (unsigned char)p[2]; ++c ) set[c] = true;
+                        p += 3;
+                    } else {
+                        set[ (unsigned char)*p++ ] = true;
+                    }
+                }
+                if( *p != ']' ) return ok = false, empty();
+                ++p;
+                set = fold( set );
+                return edge( negate ? ~set : set );
+            }
+
+            frag atom() {
+                charset cs;
+                char c = *p++;
+                switch( c ) {
+                    case '(': {
+                        frag f = alt();
+                        if( *p != ')' ) ok = false;
+                        else ++p;
+                        return f;
+                    }
+                    case '[':
+                        return set();
+                    case '.':
+                        cs.set(), cs[' '] = cs['\t'] = false;
+                        return edge( cs );
+                    case '\\':
+                        if( !*p || !escape( *p++, cs ) ) ok = false;
+                        return edge( cs );
+                    case '\0':
+                        --p; // keep p on terminator
+                        ok = false;
+                        return empty();
+                    case ')': case '|': case '*': case '+': case '?':
+                        ok = false;
+                        return empty();
+                    default:
+                        cs[ (unsigned char)c ] = true;
+                        return edge( cs );
+                }
+            }
+
+            frag rep() {
+                frag f = atom();
+                while( ok && ( *p == '*' || *p == '+' || *p == '?' ) ) {
+                    char op = *p++;
+                    frag g = { n.add(), n.add() };
+                    n.nodes[ g.in ].eps.push_back( f.in );
+                    n.nodes[ f.out ].eps.push_back( g.out );
+                    if( op != '+' ) n.nodes[ g.in ].eps.push_back( g.out );  // skip
+                    if( op != '?' ) n.nodes[ f.out ].eps.push_back( f.in );  // loop
+                    f = g;
+                }
+                return f;
+            }
+
+            frag seq() {
+                frag f = empty();
+                while( ok && *p && *p != '|' && *p != ')' ) {
+                    frag g = rep();
+                    n.nodes[ f.out ].eps.push_back( g.in );
+                    f.out = g.out;
+                }
+                return f;
+            }
+
+            frag alt() {
+                frag f = seq();
+                if( *p != '|' ) return f;
+                frag g = { n.add(), n.add() };
+                n.nodes[ g.in ].eps.push_back( f.in );
+                n.nodes[ f.out ].eps.push_back( g.out );
+                while( ok && *p == '|' ) {
+                    ++p;
+                    frag h = seq();
+                    n.nodes[ g.in ].eps.push_back( h.in );
+                    n.nodes[ h.out ].eps.push_back( g.out );
+                }
+                return g;
+            }
+        };
+
+        // epsilon closure of set, sorted and unique. marks are stamped, so they never need clearing
+        struct closure {
+            const nfa &n;
+            std::vector<unsigned> mark;
+            std::vector<int> stack;
+            unsigned stamp = 0;
+
+            closure( const nfa &n ) : n(n), mark( n.nodes.size(), 0 )
+            {}
+
+            void operator()( std::vector<int> &set ) {
+                ++stamp;
+                size_t unique = 0;
+                for( int s : set ) if( mark[s] != stamp ) mark[s] = stamp, set[ unique++ ] = s;
+                set.resize( unique );
+                stack = set;
+                while( !stack.empty() ) {
+                    int s = stack.back();
+                    stack.pop_back();
+                    for( int t : n.nodes[s].eps ) {
+                        if( mark[t] != stamp ) mark[t] = stamp, set.push_back( t ), stack.push_back( t );
+                    }
+                }
+                std::sort( set.begin(), set.end() );
+            }
+        };
+    }
+
+    bool valid( const std::string &pattern ) {
+        nfa n;
+        parser p( n, pattern.c_str() );
+        p.alt();
+        return p.ok && !*p.p && !pattern.empty();
+    }
+
+    std::string literal( const std::string &text ) {
+        std::string out;
+        for( char c : text ) {
+            if( !( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) ) ) out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    bool machine::compile( const std::vector< std::pair<std::string, int> > &rules, const char *delimiters ) {
+        // nfa, one branch per rule
+        nfa n;
+        int start = n.add();
+        for( size_t r = 0; r < rules.size(); ++r ) {
+            parser p( n, rules[r].first.c_str() );
+            frag f = p.alt();
+            if( !p.ok || *p.p ) return false;
+            n.nodes[ start ].eps.push_back( f.in );
+            n.nodes[ f.out ].accept = int( r );
+        }
+
+        // byte classes: bytes that no edge tells apart share a column
+        std::vector<int> cls( 256, 0 );
+        int ncls = 1;
+        for( auto &node : n.nodes ) {
+            if( node.out < 0 ) continue;
+            std::map< std::pair<int, bool>, int > split;
+            for( int b = 0; b < 256; ++b ) {
+                auto key = std::make_pair( cls[b], bool( node.set[b] ) );
+                auto it = split.find( key );
+                cls[b] = it != split.end() ? it->second : ( split[key] = int( split.size() ) );
+            }
+            ncls = int( split.size() );
+        }
+        std::vector<int> rep( ncls );
+        for( int b = 255; b >= 0; --b ) rep[ cls[b] ] = b;
+
+        // subset construction
+        closure close( n );
+        std::map< std::vector<int>, int > ids;
+        std::vector< std::vector<int> > sets( 1, std::vector<int>( 1, start ) );
+        std::vector< std::vector<int> > next( ncls );
+        close( sets[0] );
+        ids[ sets[0] ] = 0;
+        std::vector<int> table, accepts;
+        for( size_t d = 0; d < sets.size(); ++d ) {
+            int best = -1;
+            for( int s : sets[d] ) {
+                int a = n.nodes[s].accept;
+                if( a >= 0 && ( best < 0 || a < best ) ) best = a;
+            }
+            accepts.push_back( best );
+            for( int s : sets[d] ) {
+                const nfa::node &node = n.nodes[s];
+                if( node.out < 0 ) continue;
+                for( int c = 0; c < ncls; ++c ) {
+                    if( node.set[ rep[c] ] ) next[c].push_back( node.out );
+                }
+            }
+            for( int c = 0; c < ncls; ++c ) {
+                int id = -1;
+                if( !next[c].empty() ) {
+                    close( next[c] );
+                    auto it = ids.find( next[c] );
+                    if( it != ids.end() ) id = it->second;
+                    else {
+                        if( sets.size() >= MAX_STATES ) return false;
+                        id = ids[ next[c] ] = int( sets.size() );
+                        sets.push_back( next[c] );
+                    }
+                    next[c].clear();
+                }
+                table.push_back( id );
+            }
+        }
+
+        for( int b = 0; b < 256; ++b ) classes[b] = cls[b];
+        for( int b = 0; b < 256; ++b ) delims[b] = false;
+        for( const char *d = delimiters; *d; ++d ) delims[ (unsigned char)*d ] = true;
+        this->ncls = ncls;
+        this->table.swap( table );
+        this->accept.clear();
+        for( int a : accepts ) this->accept.push_back( a < 0 ? -1 : rules[a].second );
+        this->seen.assign( this->accept.size(), 0 );
+        this->tick = 0;
+        return true;
+    }
+} // ns ::dfa
 }
 
 // -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
@@ -465,6 +1889,45 @@ namespace dr {
     namespace {
         std::set< std::ostream * > captured;
         std::map< std::string, DR_COLOR > vhighlights;
+        std::vector< std::pair<std::string, int> > vpatterns;
+        dfa::machine vmachine;
+        bool vmachine_dirty = false, vmachine_keywords = true;    // rebuild pending; keywords compiled in
+        std::mutex vmachine_mutex;                                 // guards all of the above
+        const char *vdelimiters = "!\"#~$%&/(){}[]|,;.:<>+-/*@'\"\t\n\\ ";
+    }
+
+    namespace patterns {
+        const char *const number   = "[\\-+]?\\d+(\\.\\d+)?(e[\\-+]?\\d+)?";
+        const char *const hex      = "0x\\x+";
+        const char *const path     = "(\\.\\.?|~)?(/[\\w.\\-+@]+)+/?";
+        const char *const ipv4     = "\\d+\\.\\d+\\.\\d+\\.\\d+(:\\d+)?";
+        const char *const duration = "\\d+(\\.\\d+)?(ns|us|ms|s|min|m|h)";
+        const char *const quoted   = "\"[^\"]*\"";      // no single quotes: apostrophes open no strings
+    }
+
+    // called by logger, with vmachine_mutex held. keywords go first, so they win over patterns of same length.
+    // when keywords do not fit into the dfa, patterns are compiled alone and keywords are looked up per token
+    void rebuild_highlights() {
+        if( !dr::vmachine_dirty ) return;
+        dr::vmachine_dirty = false;
+
+        // keywords alone take one state per node of their trie: skip attempts that cannot fit
+        size_t trie = 1;
+        const std::string *prev = 0;
+        std::vector< std::pair<std::string, int> > rules;
+        for( auto &hl : dr::vhighlights ) {
+            size_t common = 0;
+            while( prev && common < prev->size() && common < hl.first.size() && (*prev)[common] == hl.first[common] ) ++common;
+            trie += hl.first.size() - common;
+            prev = &hl.first;
+            rules.push_back( std::make_pair( dfa::literal( hl.first ), int( hl.second ) ) );
+        }
+        rules.insert( rules.end(), dr::vpatterns.begin(), dr::vpatterns.end() );
+
+        dfa::machine m;
+        dr::vmachine_keywords = trie < dfa::MAX_STATES && m.compile( rules, dr::vdelimiters );
+        if( !dr::vmachine_keywords ) m.compile( dr::vpatterns, dr::vdelimiters ); // fits: see highlight_patterns()
+        std::swap( dr::vmachine, m );
     }
 
     void logger( bool open, bool feed, bool close, const std::string &line );
@@ -500,26 +1963,33 @@ namespace dr {
         return text;
     }
 
-    // tokenize_incl_separators
-    std::vector< std::string > split( const std::string &string, const std::string &delimiters ) {
-        std::string str;
-        std::vector< std::string > tokens;
-        for( auto &ch : string ) {
-            if( delimiters.find_first_of( ch ) != std::string::npos ) {
-                if( str.size() ) tokens.push_back( str ), str = "";
-                tokens.push_back( std::string() + ch );
-            } else str += ch;
-        }
-        return str.empty() ? tokens : ( tokens.push_back( str ), tokens );
-    }
-
     void highlight( DR_COLOR color, const std::vector<std::string> &user_highlights ) {
+        std::lock_guard<std::mutex> lock( dr::vmachine_mutex );
         for( auto &highlight : user_highlights ) {
             dr::vhighlights[ lowercase(highlight) ] = color;
         }
+        dr::vmachine_dirty = true;
+    }
+
+    bool highlight_patterns( DR_COLOR color, const std::vector<std::string> &user_patterns ) {
+        for( auto &pattern : user_patterns ) {
+            if( !dfa::valid( pattern ) ) return false;
+        }
+        std::lock_guard<std::mutex> lock( dr::vmachine_mutex );
+        std::vector< std::pair<std::string, int> > rules = dr::vpatterns;
+        for( auto &pattern : user_patterns ) {
+            rules.push_back( std::make_pair( pattern, int( color ) ) );
+        }
+        // patterns (unlike keywords) have no fallback, so they must fit into a dfa on their own
+        dfa::machine m;
+        if( !m.compile( rules, dr::vdelimiters ) ) return false;
+        dr::vpatterns.swap( rules );
+        dr::vmachine_dirty = true;
+        return true;
     }
 
     std::vector<std::string> highlights( DR_COLOR color ) {
+        std::lock_guard<std::mutex> lock( dr::vmachine_mutex );
         std::vector<std::string> out;
         for( auto &hl : dr::vhighlights ) {
             if( hl.second == color ) out.push_back( hl.first );
@@ -534,7 +2004,12 @@ namespace dr {
 
     void logger( bool open, bool feed, bool close, const std::string &line )
     {
-        static std::string cache;
+        static thread_local std::string cache;
+        static thread_local bool registered = [] {
+            if( thread_state *th = this_thread() ) th->line = &cache;
+            return true;
+        }();
+        (void)registered;
 
         if( open )
         {}
@@ -547,6 +2022,25 @@ namespace dr {
             if( cache.empty() )
                 return;
 
+            // lines are assembled per thread; serialize their output
+            std::lock_guard<std::mutex> lock( dr::output() );
+
+            // mirror printed line into archives and collectors, if any
+            mirror mirrored;
+            bool mirroring = archive::enabled() || collector::enabled();
+            if( mirroring ) {
+                mirrored.colored = archive::colored();
+                tee() = &mirrored;
+            }
+            // location belongs to this line only, whether printed or not
+            std::string where;
+            where.swap( dr::file() );
+
+            // tag lines with their scope id once more than one thread has logged
+            static bool threaded = false;
+            static const std::thread::id first = std::this_thread::get_id();
+            if( first != std::this_thread::get_id() ) threaded = true;
+
             static size_t num_errors = 0;
             std::string err = dr::get_any_error();
             // num lines to display in red
@@ -556,18 +2050,23 @@ namespace dr {
                 dr::printf( DR_WHITE_ALT, DR_CLOCKs " ", DR_CLOCK );
             }
 
-            std::string prefix = dr::prefix();
-            static int prevlvl = 0;
-            int lvl = prefix.size(), last = lvl - 1;
+            const context ctx = dr::current();
+            static thread_local int prevlvl = 0;
+            static thread_local unsigned previd = 0;
+            int lvl = ctx.depth, last = lvl - 1;
             bool pushes = (lvl > prevlvl), pops = (lvl < prevlvl), same = (lvl == prevlvl);
+            // a new scope at the same depth (ie, next task on a pool thread) is drawn as an opening one
+            bool enters = ctx.id != previd;
+            if( same && enters ) pushes = true, same = false;
+            previd = ctx.id;
             if( dr::log_branch ) {
                 dr::printf( DR_GRAY, "|" );
-                for( int i = 0; i < prefix.size(); i ++ ) {
+                for( int i = 0; i < lvl; i ++ ) {
                     int color = ( DR_GRAY + 1 + i ) % DR_TOTAL_COLORS;
                     /**/ if( lvl < prevlvl ) {
                         dr::printf( color, i==last ? "/" : "|" );
                     }
-                    else if( lvl > prevlvl ) {
+                    else if( pushes ) {
                         dr::printf( color, i==last ? "\\" : "|" );
                     }
                     else {
@@ -576,15 +2075,18 @@ namespace dr {
                 }
                 prevlvl = lvl;
                 dr::printf( DR_DEFAULT, " " );
+                if( threaded && ctx.id ) {
+                    if( enters ) dr::printf( DR_GRAY, "#%u<#%u ", ctx.id, ctx.parent );
+                    else dr::printf( DR_GRAY, "#%u ", ctx.id );
+                }
             }
 
             if( dr::log_text ) {
-                std::vector<std::string> tags = split(lowercase(cache), "!\"#~$%&/(){}[]|,;.:<>+-/*@'\"\t\n\\ ");
-                for( auto &tag : tags ) {
-                    auto find = dr::vhighlights.find(tag);
-                    int color = ( find == dr::vhighlights.end() ? DR_DEFAULT : find->second );
-                    dr::print( color, tag );
-                }
+                std::lock_guard<std::mutex> lock( dr::vmachine_mutex );
+                rebuild_highlights();
+                dr::vmachine.paint( cache, dr::vmachine_keywords ? 0 : &dr::vhighlights, [&]( int color, size_t begin, size_t end ) {
+                    dr::print( color, cache.substr( begin, end - begin ) );
+                } );
             }
 
             if( dr::log_errno ) {
@@ -592,17 +2094,20 @@ namespace dr {
             }
 
             if( dr::log_location ) {
-                if( dr::file().size() ) {
-                    dr::printf( DR_GRAY, " %s", dr::file().c_str() );
-                    dr::file() = std::string();
+                if( where.size() ) {
+                    dr::printf( DR_GRAY, " %s", where.c_str() );
                 }
             }
 
             if( dr::log_branch_scope ) {
-                if( pops ) {
-                    dr::printf( DR_MAGENTA, " %s", spent().c_str() );
-                    spent() = std::string();
+                // timings are tagged with their scope id unless the branch above makes it obvious
+                // (single thread, single scope closed right before this popping line)
+                bool tag = threaded || !pops || spent().size() > 1;
+                for( auto &closed : spent() ) {
+                    if( tag ) dr::printf( DR_MAGENTA, " #%u scoped for %ss", closed.first, to_string( closed.second ).c_str() );
+                    else dr::printf( DR_MAGENTA, " scoped for %ss", to_string( closed.second ).c_str() );
                 }
+                spent().clear();
             }
 
             num_errors = 0;
@@ -610,6 +2115,24 @@ namespace dr {
 
             fputs( "\n", stdout );
 
+            if( mirroring ) {
+                tee() = 0;
+                mirrored.flat += '\n';
+                if( archive::enabled() ) {
+                    archive::write( mirrored.colored ? mirrored.ansi += '\n' : mirrored.flat );
+                }
+                if( collector::enabled() ) {
+                    if( !collector::structured() ) collector::write( mirrored.flat );
+                    else {
+                        // tab-separated: time, scope, parent scope, depth, text, error, location
+                        char head[96];
+                        sprintf( head, "%.3f\t%u\t%u\t%u\t", DR_CLOCK, ctx.id, ctx.parent, ctx.depth );
+                        using collector::escape;
+                        collector::write( head + escape( cache ) + '\t' + escape( err ) + '\t' + escape( where ) + '\n' );
+                    }
+                }
+            }
+
             cache = std::string();
         }
         else
@@ -10,6 +10,8 @@
 #include <vector>
 #include <sstream>
 #include <iostream>
+#include <functional>
+#include <type_traits>
 
 #define DRECHO_VERSION "1.0.0" // (2016/04/11): Initial semantic versioning adherence
 
@@ -60,22 +62,90 @@ namespace dr {
     void highlight( DR_COLOR color, const std::vector<std::string> &highlights );
     std::vector<std::string> highlights( DR_COLOR color );
 
+    // pattern highlighting. patterns are case-insensitive and match whole tokens. all keywords and patterns
+    // get compiled into a single dfa, one pass per line. syntax: \d digit, \x hex digit, \w word char,
+    // \s blank, . any non-blank, [a-z] [^...] sets, * + ? repeats, (a|b) groups, \ escapes anything else.
+    // returns false (and keeps previous patterns) if a pattern is invalid, or if patterns do not fit into a dfa.
+    bool highlight_patterns( DR_COLOR color, const std::vector<std::string> &patterns );
+
+    namespace patterns {            // built-in patterns, ie: dr::highlight_patterns( DR_CYAN, { dr::patterns::hex } );
+        extern const char *const number, *const hex, *const path, *const ipv4, *const duration, *const quoted;
+    }
+
     // api for low-level printing
     int print( int color, const std::string &str );
     int printf( int color, const char *str, ... );
 
+    // api for typed printing. format string is parsed and type-checked at compile time (see DR_PRINTF, DR_LOGF)
+    template<typename FMT, typename... Args> int printf( int color, const Args &... args );
+    template<typename FMT, typename... Args> const std::string &format( const Args &... args ); // per-thread buffer
+
+    // api for archives. logged lines are also appended to rotating segments (basename.0000.flat.drz, ...)
+    // numbering resumes after existing segments. segments are LZ-compressed in blocks by a background thread.
+    // read them back with read() or tools/drcat. open() returns false if first segment cannot be created
+    namespace archive {
+        bool open( const std::string &basename, bool ansi = false, size_t segment_size = 256 << 20, size_t block_size = 256 << 10 );
+        void close();
+
+        struct stats_t {
+            unsigned long long raw, packed, blocks, segments;
+            unsigned long long dropped; // blocks that could not be written
+            double cpu;             // seconds of cpu spent by the background thread
+        };
+        stats_t stats();            // current archive, or last closed one
+
+        // stream-decompress a segment, block by block
+        bool read( const std::string &pathfile, const std::function<void( const char *data, size_t len )> &fn );
+
+        // codec
+        void compress( const char *src, size_t len, std::string &out );
+        bool decompress( const char *src, size_t len, char *dst, size_t raw );
+    }
+
+    // api for collectors. logged lines (flat, or tab-separated fields when structured) are sent to a local
+    // collector daemon over a unix socket, batched into large datagrams. sends never block; drops are counted
+    namespace collector {
+        bool open( const std::string &path, bool seqpacket = false, bool structured = false, size_t datagram_size = 32 << 10, size_t batch = 32 );
+        void flush();
+        void close();
+
+        struct stats_t {
+            unsigned long long lines, datagrams, syscalls, dropped_lines, dropped_datagrams;
+            unsigned long long truncated_lines; // longer than datagram_size
+        };
+        stats_t stats();            // current collector, or last closed one
+    }
+
     // api for errors
     std::string get_any_error();
     void clear_errors();
 
+    // api for crashes. on fatal signals, flush pending output and dump active scopes of every thread and last
+    // detected error, with async-signal-safe calls only; then chain to previous handlers. returns false if unchanged
+    bool crash_handler( bool enable = true );
+
     // api for time
     double clock();
 
     // api for scopes
+    struct context {
+        unsigned id, parent, depth; // id 0 is the root scope
+    };
+
+    context this_context();         // capture current scope of calling thread
+
     struct scope {
          scope(/*attribs: tab, time, color*/);
+         scope( const context &parent ); // open a child scope of a captured context (ie, on a worker thread)
         ~scope();
         double clock;
+        context ctx, prev;
+    };
+
+    struct adopt {                  // re-enter a captured context in calling thread, until destroyed
+         adopt( const context &ctx );
+        ~adopt();
+        context prev;
     };
 
     using tab = scope;
@@ -93,6 +163,198 @@ namespace dr {
 
 // -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
 
+// compile-time format parsing. FMT is a type with a `static constexpr const char *str()` member.
+// every conversion gets unrolled into a direct append call of the matching argument type;
+// plain %d %i %u %x %X %o %c %s %f %.Nf are appended natively, anything else (%hd, widths, flags...) falls back to snprintf.
+
+namespace dr {
+namespace fmt {
+    enum { END, PERCENT, INT, FLOAT, STR, CHAR, PTR, BAD };
+
+    // index of next '%' (or terminator) at or after i
+    constexpr unsigned find( const char *s, unsigned i ) {
+        return !s[i] || s[i] == '%' ? i : find( s, i + 1 );
+    }
+    constexpr bool flag( char c )   { return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0'; }
+    constexpr bool digit( char c )  { return c >= '0' && c <= '9'; }
+    constexpr bool length( char c ) { return c == 'h' || c == 'l' || c == 'L' || c == 'z' || c == 'j' || c == 't' || c == 'q'; }
+    // index of conversion char in spec starting at i ('%' position)
+    constexpr unsigned skip( const char *s, unsigned i, bool( *pred )( char ) ) {
+        return pred( s[i] ) ? skip( s, i + 1, pred ) : i;
+    }
+    constexpr unsigned precision_end( const char *s, unsigned i ) {
+        return s[i] == '.' ? skip( s, i + 1, digit ) : i;
+    }
+    constexpr unsigned conversion( const char *s, unsigned i ) {
+        return skip( s, precision_end( s, skip( s, skip( s, i + 1, flag ), digit ) ), length );
+    }
+    constexpr int kind( char c ) {
+        return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'o' ? INT
+             : c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' || c == 'A' ? FLOAT
+             : c == 's' ? STR : c == 'c' ? CHAR : c == 'p' ? PTR : BAD;
+    }
+    constexpr int kind_at( const char *s, unsigned at ) {
+        return !s[at] ? END : s[at + 1] == '%' ? PERCENT : kind( s[ conversion( s, at ) ] );
+    }
+    // precision of a "%.Nf" spec, or -1 if spec has flags, width or length modifiers
+    constexpr int number( const char *s, unsigned i, unsigned end, int acc ) {
+        return i < end ? number( s, i + 1, end, acc * 10 + ( s[i] - '0' ) ) : acc;
+    }
+    constexpr int precision( const char *s, unsigned at, unsigned conv ) {
+        return conv == at + 1 ? 6
+             : s[at + 1] == '.' && skip( s, at + 2, digit ) == conv ? number( s, at + 2, conv, 0 )
+             : -1;
+    }
+    constexpr bool plain( const char *s, unsigned at, unsigned conv ) {
+        return kind( s[conv] ) == FLOAT ? ( s[conv] == 'f' || s[conv] == 'F' ) && precision( s, at, conv ) >= 0 && precision( s, at, conv ) <= 9
+             : kind( s[conv] ) == PTR ? false
+             : skip( s, at + 1, length ) == conv && s[conv - 1] != 'h';
+    }
+
+    template<int K, typename T> struct accepts {
+        typedef typename std::decay<T>::type type;
+        enum { value =
+            K == INT || K == CHAR ? std::is_integral<type>::value || ( std::is_enum<type>::value && std::is_convertible<type, long long>::value ) :
+            K == FLOAT ? std::is_floating_point<type>::value :
+            K == STR ? std::is_same<type, const char *>::value || std::is_same<type, char *>::value || std::is_same<type, std::string>::value :
+            K == PTR ? std::is_pointer<type>::value || std::is_same<type, std::nullptr_t>::value :
+            false
+        };
+    };
+
+    // runtime appenders (drecho.cpp)
+    void put_int( std::string &out, long long value );
+    void put_uint( std::string &out, unsigned long long value, unsigned base, bool upper );
+    void put_float( std::string &out, double value, int precision );
+    void put_spec( std::string &out, const char *spec, unsigned len, long long value );
+    void put_spec( std::string &out, const char *spec, unsigned len, unsigned long long value );
+    void put_spec( std::string &out, const char *spec, unsigned len, double value );
+    void put_spec( std::string &out, const char *spec, unsigned len, const char *value );
+    void put_spec( std::string &out, const char *spec, unsigned len, const void *value );
+
+    // unsigned conversions keep (promoted) argument width, as printf does for %u %x %o
+    template<typename T> unsigned long long widen( T v ) {
+        return (typename std::make_unsigned<decltype(+v)>::type)( +v );
+    }
+
+    template<typename T> const char *c_str( const T &s ) { return s; }
+    inline const char *c_str( const std::string &s ) { return s.c_str(); }
+
+    template<char C, bool PLAIN> struct put;
+    template<char C> struct put<C, true> {
+        template<typename T> static void integer( std::string &out, T v, std::true_type /*signed*/ ) {
+            if( C == 'd' || C == 'i' ) put_int( out, (long long)v );
+            else put_uint( out, widen( v ), C == 'o' ? 8 : C == 'u' ? 10 : 16, C == 'X' );
+        }
+        template<typename T> static void integer( std::string &out, T v, std::false_type ) {
+            put_uint( out, (unsigned long long)v, C == 'o' ? 8 : C == 'x' || C == 'X' ? 16 : 10, C == 'X' );
+        }
+        template<typename T> static void value( std::string &out, const T &v, const char *, unsigned, unsigned, std::integral_constant<int, INT> ) {
+            integer( out, v, std::integral_constant<bool, std::is_signed<T>::value || std::is_enum<T>::value>() );
+        }
+        template<typename T> static void value( std::string &out, const T &v, const char *, unsigned, unsigned, std::integral_constant<int, CHAR> ) {
+            out += (char)v;
+        }
+        template<typename T> static void value( std::string &out, const T &v, const char *s, unsigned at, unsigned conv, std::integral_constant<int, FLOAT> ) {
+            put_float( out, (double)v, precision( s, at, conv ) );
+        }
+        template<typename T> static void value( std::string &out, const T &v, const char *, unsigned, unsigned, std::integral_constant<int, STR> ) {
+            const char *str = c_str( v );
+            out += str ? str : "(null)";
+        }
+    };
+    template<char C> struct put<C, false> {
+        template<typename T> static void value( std::string &out, const T &v, const char *s, unsigned at, unsigned conv, std::integral_constant<int, INT> ) {
+            if( C == 'd' || C == 'i' ) put_spec( out, s + at, conv + 1 - at, (long long)v );
+            else put_spec( out, s + at, conv + 1 - at, widen( v ) );
+        }
+        template<typename T> static void value( std::string &out, const T &v, const char *s, unsigned at, unsigned conv, std::integral_constant<int, CHAR> ) {
+            put_spec( out, s + at, conv + 1 - at, (long long)v );
+        }
+        template<typename T> static void value( std::string &out, const T &v, const char *s, unsigned at, unsigned conv, std::integral_constant<int, FLOAT> ) {
+            put_spec( out, s + at, conv + 1 - at, (double)v );
+        }
+        template<typename T> static void value( std::string &out, const T &v, const char *s, unsigned at, unsigned conv, std::integral_constant<int, STR> ) {
+            put_spec( out, s + at, conv + 1 - at, c_str( v ) );
+        }
+        template<typename T> static void value( std::string &out, const T &v, const char *s, unsigned at, unsigned conv, std::integral_constant<int, PTR> ) {
+            put_spec( out, s + at, conv + 1 - at, (const void *)v );
+        }
+    };
+
+    template<typename FMT, unsigned POS, typename... Args>
+    void format( std::string &out, const Args &... args );
+
+    template<typename FMT, unsigned POS, unsigned AT, int K>
+    struct step {
+        static void run( std::string & ) {
+            static_assert( K < 0, "dr::fmt: too few arguments for format string" );
+        }
+        template<typename T, typename... Args>
+        static void run( std::string &out, const T &arg, const Args &... args ) {
+            static_assert( K != BAD, "dr::fmt: unsupported conversion specifier in format string" );
+            static_assert( K == BAD || accepts<K, T>::value, "dr::fmt: argument type does not match conversion specifier" );
+            enum { CONV = conversion( FMT::str(), AT ) };
+            out.append( FMT::str() + POS, AT - POS );
+            put< FMT::str()[CONV], plain( FMT::str(), AT, CONV ) >::value( out, arg, FMT::str(), AT, CONV, std::integral_constant<int, K>() );
+            format<FMT, CONV + 1>( out, args... );
+        }
+    };
+    template<typename FMT, unsigned POS, unsigned AT>
+    struct step<FMT, POS, AT, END> {
+        static void run( std::string &out ) {
+            out.append( FMT::str() + POS, AT - POS );
+        }
+        template<typename T, typename... Args>
+        static void run( std::string &, const T &, const Args &... ) {
+            static_assert( sizeof(T) < 0, "dr::fmt: too many arguments for format string" );
+        }
+    };
+    template<typename FMT, unsigned POS, unsigned AT>
+    struct step<FMT, POS, AT, PERCENT> {
+        template<typename... Args>
+        static void run( std::string &out, const Args &... args ) {
+            out.append( FMT::str() + POS, AT - POS );
+            out += '%';
+            format<FMT, AT + 2>( out, args... );
+        }
+    };
+
+    template<typename FMT, unsigned POS, typename... Args>
+    void format( std::string &out, const Args &... args ) {
+        enum { AT = find( FMT::str(), POS ) };
+        step<FMT, POS, AT, kind_at( FMT::str(), AT )>::run( out, args... );
+    }
+} // ns ::fmt
+
+    template<typename FMT, typename... Args>
+    const std::string &format( const Args &... args ) {
+        static thread_local std::string buffer;
+        buffer.clear();
+        fmt::format<FMT, 0>( buffer, args... );
+        return buffer;
+    }
+
+    template<typename FMT, typename... Args>
+    int printf( int color, const Args &... args ) {
+        return dr::print( color, dr::format<FMT>( args... ) );
+    }
+
+namespace fmt {
+    // macro helpers: format string is passed along with the arguments, so macros need no empty __VA_ARGS__
+    template<typename FMT, typename... Args>
+    int print( int color, const char *, const Args &... args ) {
+        return dr::printf<FMT>( color, args... );
+    }
+    template<typename FMT, typename... Args>
+    const std::string &log( const char *, const Args &... args ) {
+        return dr::format<FMT>( args... );
+    }
+} // ns ::fmt
+}
+
+// -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
 #ifdef _MSC_VER
 #define DR_LINE   __LINE__
 #define DR_FUNC   __FUNCTION__
@@ -104,11 +366,19 @@ namespace dr {
 #endif
 
 // API for macros
+#define DR_FMT(fmt)  struct dr_fmt { static constexpr const char *str() { return fmt; } }
+#define DR_PRINTF(color, ...) do { DR_FMT(DR_FIRST(__VA_ARGS__)); dr::fmt::print<dr_fmt>( color, __VA_ARGS__ );  } while(0)
+#define DR_EXPAND(x)          x
+#define DR_FIRST(...)         DR_EXPAND( DR_FIRST_( __VA_ARGS__, 0 ) )
+#define DR_FIRST_(first, ...) first
+
 #if defined(NDEBUG) || defined(_NDEBUG)
 #   define DR_LOG(...)
+#   define DR_LOGF(...)
 #   define DR_SCOPE(...)
 #else
 #   define DR_LOG(...)    do { dr::echo << ( dr::concat(), __VA_ARGS__ ).str() << std::endl;  } while(0)
+#   define DR_LOGF(...)   do { DR_FMT(DR_FIRST(__VA_ARGS__)); dr::echo << dr::fmt::log<dr_fmt>( __VA_ARGS__ ) << std::endl;  } while(0)
 #   define DR_SCOPE(...)  dr::scope dr_scope(__VA_ARGS__)
 #   define echo  echo << dr::location(DR_FUNC,DR_FILE,DR_LINE)
 #   define $cerr cerr << dr::location(DR_FUNC,DR_FILE,DR_LINE)
@@ -0,0 +1,59 @@
+// DrCat, stream-decompresses DrEcho log archives (.drz segments) to stdout, for grepping and replay
+// - rlyeh, zlib/libpng licensed.
+
+// usage: drcat [-s] segment.drz [segment.drz...]
+//   -s reports compression ratio and decompression throughput to stderr.
+//
+// ie, drcat app.*.flat.drz | grep error
+//     drcat app.*.ansi.drz | less -R
+
+// build: g++ -O2 -std=c++11 tools/drcat.cpp drecho.cpp -o drcat -lGL -lGLU -pthread
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "../drecho.hpp"
+
+// default settings
+const bool dr::log_timestamp = true;
+const bool dr::log_branch = true;
+const bool dr::log_branch_scope = true;
+const bool dr::log_text = true;
+const bool dr::log_errno = true;
+const bool dr::log_location = true;
+
+int main( int argc, const char **argv ) {
+    bool stats = argc > 1 && !strcmp( argv[1], "-s" );
+    int first = stats ? 2 : 1;
+
+    if( first >= argc ) {
+        fprintf( stderr, "usage: %s [-s] segment.drz [segment.drz...]\n", argv[0] );
+        return 1;
+    }
+
+    int errors = 0;
+    for( int i = first; i < argc; ++i ) {
+        FILE *fp = fopen( argv[i], "rb" );
+        long packed = 0;
+        if( fp ) fseek( fp, 0, SEEK_END ), packed = ftell( fp ), fclose( fp );
+
+        unsigned long long raw = 0;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = dr::archive::read( argv[i], [&]( const char *data, size_t len ) {
+            fwrite( data, 1, len, stdout );
+            raw += len;
+        } );
+        double secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+        if( !ok ) {
+            fprintf( stderr, "drcat: '%s' is missing, truncated or corrupt\n", argv[i] );
+            errors++;
+        }
+        if( stats ) {
+            fprintf( stderr, "%s: %llu -> %ld bytes (%.1f%%), %.1f MiB/s\n", argv[i], raw, packed,
+                raw ? packed * 100.0 / raw : 0.0, secs > 0 ? raw / secs / ( 1 << 20 ) : 0.0 );
+        }
+    }
+
+    return errors ? 1 : 0;
+}
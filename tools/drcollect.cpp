@@ -0,0 +1,144 @@
+// DrCollect, a small stand-in for a local log collector daemon (see dr::collector)
+// - rlyeh, zlib/libpng licensed.
+
+// usage: drcollect [-p] [-q] [-s] [-n lines] socketpath
+//   -p  use SOCK_SEQPACKET instead of SOCK_DGRAM
+//   -q  do not print received lines
+//   -s  lines carry a 'seq=<n>' counter: report gaps (drops) and reorders
+//   -n  exit after receiving that many lines (otherwise, 2 seconds after traffic stops)
+//
+// checks that timestamps (first field of flat and structured lines) never go backwards, and reports throughput.
+//
+// drive it with tools/drfeed.cpp, which logs numbered lines through dr::collector:
+//   drcollect -q -s -n 1000000 /tmp/app.sock &
+//   drfeed -n 1000000 /tmp/app.sock > /dev/null
+
+// build: g++ -O2 -std=c++11 tools/drcollect.cpp -o drcollect
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct checker {
+        unsigned long long lines = 0, bytes = 0, datagrams = 0;
+        unsigned long long backwards = 0, gaps = 0, missing = 0, reorders = 0;
+        double last_time = -1;
+        long long last_seq = -1;
+        bool sequence = false;
+
+        void line( const char *begin, const char *end ) {
+            lines++;
+
+            // leading timestamp: "0001.234s |..." or "1.234\t..."
+            char *stop;
+            double t = strtod( begin, &stop );
+            if( stop != begin ) {
+                if( t < last_time ) backwards++;
+                last_time = t;
+            }
+
+            if( sequence ) {
+                std::string text( begin, end );
+                size_t pos = text.find( "seq=" );
+                if( pos != std::string::npos ) {
+                    long long seq = strtoll( text.c_str() + pos + 4, 0, 10 );
+                    if( last_seq >= 0 && seq <= last_seq ) reorders++;
+                    else if( last_seq >= 0 && seq > last_seq + 1 ) gaps++, missing += seq - last_seq - 1;
+                    last_seq = seq;
+                }
+            }
+        }
+    };
+}
+
+int main( int argc, const char **argv ) {
+    bool seqpacket = false, quiet = false;
+    unsigned long long limit = 0;
+    checker chk;
+
+    int arg = 1;
+    for( ; arg < argc && argv[arg][0] == '-'; ++arg ) {
+        std::string opt = argv[arg];
+        /**/ if( opt == "-p" ) seqpacket = true;
+        else if( opt == "-q" ) quiet = true;
+        else if( opt == "-s" ) chk.sequence = true;
+        else if( opt == "-n" && arg + 1 < argc ) limit = strtoull( argv[++arg], 0, 10 );
+        else break;
+    }
+    if( arg >= argc ) {
+        fprintf( stderr, "usage: %s [-p] [-q] [-s] [-n lines] socketpath\n", argv[0] );
+        return 1;
+    }
+    const char *path = argv[arg];
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if( strlen( path ) >= sizeof(addr.sun_path) ) return fprintf( stderr, "drcollect: path too long\n" ), 1;
+    strcpy( addr.sun_path, path );
+    unlink( path );
+
+    int fd = socket( AF_UNIX, seqpacket ? SOCK_SEQPACKET : SOCK_DGRAM, 0 );
+    int rcvbuf = 8 << 20;
+    setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf) );
+    if( fd < 0 || bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0 ) {
+        return fprintf( stderr, "drcollect: cannot bind '%s': %s\n", path, strerror( errno ) ), 1;
+    }
+    if( seqpacket ) {
+        int server = fd;
+        if( listen( server, 1 ) < 0 || ( fd = accept( server, 0, 0 ) ) < 0 ) {
+            return fprintf( stderr, "drcollect: cannot accept: %s\n", strerror( errno ) ), 1;
+        }
+        close( server );
+    }
+
+    std::vector<char> buf( 1 << 20 );
+    auto start = std::chrono::steady_clock::now();
+    bool started = false;
+
+    while( !limit || chk.lines < limit ) {
+        ssize_t n = recv( fd, &buf[0], buf.size(), 0 );
+        if( n < 0 && errno == EINTR ) continue;
+        if( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) break; // idle
+        if( n <= 0 ) break; // peer closed (seqpacket) or error
+
+        if( !started ) {
+            // measure from first datagram, and stop once traffic stops
+            started = true;
+            start = std::chrono::steady_clock::now();
+            struct timeval tv = { 2, 0 };
+            setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv) );
+        }
+
+        chk.datagrams++;
+        chk.bytes += n;
+        if( !quiet ) fwrite( &buf[0], 1, n, stdout );
+        for( const char *it = &buf[0], *end = it + n; it < end; ) {
+            const char *nl = (const char *)memchr( it, '\n', end - it );
+            const char *eol = nl ? nl : end;
+            chk.line( it, eol );
+            it = eol + 1;
+        }
+    }
+
+    double secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    fprintf( stderr, "drcollect: %llu lines, %llu datagrams, %.1f MiB in %.3fs (%.0f lines/s, %.1f MiB/s)\n",
+        chk.lines, chk.datagrams, chk.bytes / 1048576.0, secs, secs > 0 ? chk.lines / secs : 0.0, secs > 0 ? chk.bytes / 1048576.0 / secs : 0.0 );
+    fprintf( stderr, "drcollect: %llu timestamps going backwards", chk.backwards );
+    if( chk.sequence ) fprintf( stderr, ", %llu reorders, %llu gaps (%llu lines missing)", chk.reorders, chk.gaps, chk.missing );
+    fprintf( stderr, "\n" );
+
+    close( fd );
+    unlink( path );
+    return chk.backwards || chk.reorders ? 1 : 0;
+}
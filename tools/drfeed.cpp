@@ -0,0 +1,76 @@
+// DrFeed, drives dr::collector with numbered lines, to check delivery against tools/drcollect
+// - rlyeh, zlib/libpng licensed.
+
+// usage: drfeed [-p] [-s] [-n lines] [-d datagram_size] [-b batch] socketpath
+//   -p  use SOCK_SEQPACKET instead of SOCK_DGRAM
+//   -s  send structured (tab-separated) lines instead of flat ones
+//   -n  number of lines to log (default 1000000). each one carries a 'seq=<n>' counter
+//   -d  -b  datagram size and batch length, as in dr::collector::open()
+//
+// run the collector first, then the feeder (terminal output is discarded, stats go to stderr):
+//   drcollect -q -s -n 1000000 /tmp/app.sock &
+//   drfeed -n 1000000 /tmp/app.sock > /dev/null
+// drcollect reports throughput, reorders and gaps; drfeed reports what dr::collector sent and dropped.
+
+// build: g++ -O2 -std=c++11 tools/drfeed.cpp drecho.cpp -o drfeed -lGL -lGLU -pthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "../drecho.hpp"
+
+// default settings
+const bool dr::log_timestamp = true;
+const bool dr::log_branch = false;
+const bool dr::log_branch_scope = false;
+const bool dr::log_text = true;
+const bool dr::log_errno = false;
+const bool dr::log_location = false;
+
+int main( int argc, const char **argv ) {
+    bool seqpacket = false, structured = false;
+    unsigned long long lines = 1000000;
+    size_t datagram_size = 32 << 10, batch = 32;
+
+    int arg = 1;
+    for( ; arg < argc && argv[arg][0] == '-'; ++arg ) {
+        std::string opt = argv[arg];
+        /**/ if( opt == "-p" ) seqpacket = true;
+        else if( opt == "-s" ) structured = true;
+        else if( opt == "-n" && arg + 1 < argc ) lines = strtoull( argv[++arg], 0, 10 );
+        else if( opt == "-d" && arg + 1 < argc ) datagram_size = strtoull( argv[++arg], 0, 10 );
+        else if( opt == "-b" && arg + 1 < argc ) batch = strtoull( argv[++arg], 0, 10 );
+        else break;
+    }
+    if( arg >= argc ) {
+        fprintf( stderr, "usage: %s [-p] [-s] [-n lines] [-d datagram_size] [-b batch] socketpath\n", argv[0] );
+        return 1;
+    }
+    const char *path = argv[arg];
+
+    // give a collector started in background a moment to bind
+    bool ok = false;
+    for( int retry = 0; retry < 50 && !ok; ++retry ) {
+        ok = dr::collector::open( path, seqpacket, structured, datagram_size, batch );
+        if( !ok ) std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+    }
+    if( !ok ) {
+        fprintf( stderr, "drfeed: cannot connect to '%s'\n", path );
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for( unsigned long long i = 0; i < lines; ++i ) {
+        dr::echo << "request served seq=" << i << " status=200 path=/api/v1/items" << std::endl;
+    }
+    dr::collector::close();
+    double secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    auto st = dr::collector::stats();
+    fprintf( stderr, "drfeed: %llu lines in %.3fs (%.0f lines/s)\n", lines, secs, secs > 0 ? lines / secs : 0.0 );
+    fprintf( stderr, "drfeed: sent %llu lines in %llu datagrams with %llu syscalls; dropped %llu lines in %llu datagrams\n",
+        st.lines, st.datagrams, st.syscalls, st.dropped_lines, st.dropped_datagrams );
+    return 0;
+}
@@ -0,0 +1,492 @@
+// DrView, offline viewer and query tool for DrEcho logs (.flat and .ansi flavors)
+// - rlyeh, zlib/libpng licensed.
+
+// usage: drview [-j threads] [-p] [-c color=keyword,keyword...] logfile [keyword...] [-keyword...]
+//
+// - logfile is memory-mapped and split into chunks on line boundaries; chunks are scanned on all cores.
+// - query follows DrEcho filtering semantics: 'error -debug' lists lines with 'error' keyword that have
+//   no 'debug' keywords in it. all positive keywords must be present. no keywords lists everything.
+// - matching lines are re-rendered with their enclosing dr::scope branch lines as (gray) context.
+//   lines tagged '#id' (multi-threaded logs) get the opening lines of their parent scopes instead, so
+//   context always comes from the same scope tree, whatever the interleaving of threads.
+// - -c may be repeated; colors are: red, green, yellow, blue, magenta, purple, cyan, white, gray (+ _alt).
+// - -p disables colors (also disabled when stdout is not a terminal).
+
+// build: g++ -O2 -std=c++11 tools/drview.cpp -o drview -pthread
+
+// -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#   include <windows.h>
+#   include <io.h>
+#   define isatty _isatty
+#   define fileno _fileno
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#include "../drecho.hpp"
+#undef echo
+
+// -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+namespace
+{
+    const size_t npos = ~size_t(0);
+
+    // same delimiters dr::logger uses to tokenize lines
+    const char *delimiters = "!\"#~$%&/(){}[]|,;.:<>+-/*@'\"\t\n\\ ";
+
+    const char *ansi( int color ) {
+        switch( color ) {
+            case DR_RED:         return "31";
+            case DR_GREEN:       return "32";
+            case DR_YELLOW:      return "33";
+            case DR_BLUE:        return "34";
+            case DR_MAGENTA:     return "35";
+            case DR_CYAN:        return "36";
+            case DR_WHITE:       return "37";
+            case DR_GRAY:        return "90";
+            case DR_RED_ALT:     return "91";
+            case DR_GREEN_ALT:   return "92";
+            case DR_YELLOW_ALT:  return "93";
+            case DR_BLUE_ALT:    return "94";
+            case DR_MAGENTA_ALT: return "95";
+            case DR_CYAN_ALT:    return "96";
+            case DR_WHITE_ALT:   return "97";
+            default:             return 0;
+        }
+    }
+
+    int color_by_name( const std::string &name ) {
+        static const struct { const char *name; int color; } table[] = {
+            { "red", DR_RED }, { "green", DR_GREEN }, { "yellow", DR_YELLOW }, { "blue", DR_BLUE },
+            { "magenta", DR_MAGENTA }, { "purple", DR_PURPLE }, { "cyan", DR_CYAN }, { "white", DR_WHITE },
+            { "gray", DR_GRAY }, { "red_alt", DR_RED_ALT }, { "green_alt", DR_GREEN_ALT },
+            { "yellow_alt", DR_YELLOW_ALT }, { "blue_alt", DR_BLUE_ALT }, { "magenta_alt", DR_MAGENTA_ALT },
+            { "purple_alt", DR_PURPLE_ALT }, { "cyan_alt", DR_CYAN_ALT }, { "white_alt", DR_WHITE_ALT },
+        };
+        for( auto &entry : table ) {
+            if( name == entry.name ) return entry.color;
+        }
+        return -1;
+    }
+
+    std::string lowercase( std::string text ) {
+        for( auto &ch : text ) {
+            if( ch >= 'A' && ch <= 'Z' ) ch = ( ch - 'A' ) + 'a';
+        }
+        return text;
+    }
+
+    // read-only memory map of a whole file
+    struct mapped_file {
+        const char *data = 0;
+        size_t size = 0;
+#ifdef _WIN32
+        HANDLE hfile = INVALID_HANDLE_VALUE, hmap = 0;
+#endif
+
+        bool open( const char *pathfile ) {
+#ifdef _WIN32
+            hfile = CreateFileA( pathfile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+            if( hfile == INVALID_HANDLE_VALUE ) return false;
+            LARGE_INTEGER len;
+            if( !GetFileSizeEx( hfile, &len ) ) return false;
+            size = (size_t)len.QuadPart;
+            if( !size ) return true;
+            hmap = CreateFileMappingA( hfile, NULL, PAGE_READONLY, 0, 0, NULL );
+            if( !hmap ) return false;
+            data = (const char *)MapViewOfFile( hmap, FILE_MAP_READ, 0, 0, 0 );
+            return data != 0;
+#else
+            int fd = ::open( pathfile, O_RDONLY );
+            if( fd < 0 ) return false;
+            struct stat st;
+            if( fstat( fd, &st ) < 0 ) return ::close( fd ), false;
+            size = (size_t)st.st_size;
+            if( size ) {
+                void *ptr = mmap( 0, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+                data = ptr == MAP_FAILED ? 0 : (const char *)ptr;
+                if( data ) madvise( ptr, size, MADV_SEQUENTIAL );
+            }
+            ::close( fd );
+            return !size || data;
+#endif
+        }
+
+        ~mapped_file() {
+#ifdef _WIN32
+            if( data ) UnmapViewOfFile( data );
+            if( hmap ) CloseHandle( hmap );
+            if( hfile != INVALID_HANDLE_VALUE ) CloseHandle( hfile );
+#else
+            if( data ) munmap( (void *)data, size );
+#endif
+        }
+    };
+
+    // a log line, once ansi escapes are removed, looks like: "0001.234s ||\ text"
+    // depth is the number of branch glyphs after the first '|' (0 for non-DrEcho lines).
+    // once several threads log, text is preceded by a scope tag: "#id " or "#id<#parent " when entering it.
+    struct parsed_line {
+        std::string plain;  // line contents, without ansi escapes
+        size_t branch = npos; // offset of first '|' in plain
+        size_t tag = 0;     // offset of scope tag in plain (== text if untagged)
+        size_t text = 0;    // offset of text in plain
+        int depth = 0;
+        unsigned id = 0, parent = 0;
+        bool tagged = false, enters = false;
+    };
+
+    void strip( const char *begin, const char *end, std::string &out ) {
+        out.clear();
+        for( const char *it = begin; it < end; ++it ) {
+            if( *it == '\033' && it + 1 < end && it[1] == '[' ) {
+                it += 2;
+                while( it < end && !( *it >= '@' && *it <= '~' ) ) ++it;
+                continue;
+            }
+            if( *it != '\r' ) out += *it;
+        }
+    }
+
+    void parse( const char *begin, const char *end, parsed_line &line ) {
+        strip( begin, end, line.plain );
+        const std::string &s = line.plain;
+        line.branch = npos, line.text = 0, line.depth = 0;
+        line.id = line.parent = 0, line.tagged = line.enters = false;
+
+        size_t i = 0, n = s.size();
+        // optional timestamp
+        if( i < n && s[i] >= '0' && s[i] <= '9' ) {
+            while( i < n && ( ( s[i] >= '0' && s[i] <= '9' ) || s[i] == '.' ) ) ++i;
+            if( i + 1 < n && s[i] == 's' && s[i+1] == ' ' ) i += 2;
+            else return;
+        }
+        if( i >= n || s[i] != '|' ) return;
+        line.branch = i++;
+        while( i < n && ( s[i] == '|' || s[i] == '\\' || s[i] == '/' ) ) ++i, ++line.depth;
+        line.text = line.tag = ( i < n && s[i] == ' ' ) ? i + 1 : i;
+
+        // optional scope tag
+        auto number = [&]( size_t &at, unsigned &out ) {
+            if( at + 1 >= n || s[at] != '#' || s[at + 1] < '0' || s[at + 1] > '9' ) return false;
+            for( out = 0, ++at; at < n && s[at] >= '0' && s[at] <= '9'; ++at ) out = out * 10 + unsigned( s[at] - '0' );
+            return true;
+        };
+        size_t at = line.text;
+        unsigned id, parent = 0;
+        if( !number( at, id ) ) return;
+        bool enters = at < n && s[at] == '<' && number( ++at, parent );
+        if( at < n && s[at] != ' ' ) return;
+        line.id = id, line.parent = parent, line.tagged = true, line.enters = enters;
+        line.text = at < n ? at + 1 : at;
+    }
+
+    // fast prefix-only scan, used by the first pass
+    void head_of( const char *begin, const char *end, parsed_line &line ) {
+        // branch glyphs and tags live in the first few dozen bytes; avoid stripping whole lines
+        const char *cut = end - begin > 512 ? begin + 512 : end;
+        parse( begin, cut, line );
+    }
+
+    // -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+    struct query {
+        std::vector<std::string> positives, negatives;
+        std::unordered_map<std::string, int> highlights;
+        bool colors = true;
+        bool delims[256] = {};
+
+        query() {
+            for( const char *d = delimiters; *d; ++d ) delims[ (unsigned char)*d ] = true;
+        }
+
+        template<typename FN>
+        void tokenize( const std::string &text, size_t from, FN &&fn ) const {
+            size_t start = from;
+            for( size_t i = from, n = text.size(); i <= n; ++i ) {
+                if( i == n || delims[ (unsigned char)text[i] ] ) {
+                    if( i > start ) fn( start, i );
+                    if( i < n ) fn( i, i + 1 );
+                    start = i + 1;
+                }
+            }
+        }
+
+        bool matches( const std::string &lower, size_t from ) const {
+            if( positives.empty() && negatives.empty() ) return true;
+            std::vector<bool> found( positives.size(), false );
+            bool rejected = false;
+            tokenize( lower, from, [&]( size_t b, size_t e ) {
+                if( rejected ) return;
+                for( auto &neg : negatives ) {
+                    if( neg.size() == e - b && !lower.compare( b, e - b, neg ) ) { rejected = true; return; }
+                }
+                for( size_t p = 0; p < positives.size(); ++p ) {
+                    if( positives[p].size() == e - b && !lower.compare( b, e - b, positives[p] ) ) found[p] = true;
+                }
+            } );
+            return !rejected && std::find( found.begin(), found.end(), false ) == found.end();
+        }
+
+        void paint( std::string &out, int color, const char *begin, size_t len ) const {
+            const char *code = colors ? ansi( color ) : 0;
+            if( code ) out += "\033[", out += code, out += 'm';
+            out.append( begin, len );
+            if( code ) out += "\033[m";
+        }
+
+        void render( std::string &out, const parsed_line &line, const std::string &lower, bool context ) const {
+            const std::string &s = line.plain;
+            if( context ) {
+                paint( out, DR_GRAY, s.data(), s.size() );
+                out += '\n';
+                return;
+            }
+            size_t from = 0;
+            if( line.branch != npos ) {
+                paint( out, DR_WHITE_ALT, s.data(), line.branch );
+                paint( out, DR_GRAY, s.data() + line.branch, 1 );
+                for( int i = 0; i < line.depth; ++i ) {
+                    paint( out, ( DR_GRAY + 1 + i ) % DR_TOTAL_COLORS, s.data() + line.branch + 1 + i, 1 );
+                }
+                from = line.text;
+                out.append( s, line.branch + 1 + line.depth, line.tag - ( line.branch + 1 + line.depth ) );
+                paint( out, DR_GRAY, s.data() + line.tag, from - line.tag );
+            }
+            tokenize( lower, from, [&]( size_t b, size_t e ) {
+                auto find = highlights.empty() ? highlights.end() : highlights.find( lower.substr( b, e - b ) );
+                paint( out, find == highlights.end() ? DR_DEFAULT : find->second, s.data() + b, e - b );
+            } );
+            out += '\n';
+        }
+    };
+
+    // -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+    // scope stack: offset of the latest line seen at each depth (npos if unknown)
+    typedef std::vector<size_t> stack;
+
+    // tagged scopes: id -> opening line and parent id
+    struct opening { size_t offset; unsigned parent; };
+    typedef std::unordered_map<unsigned, opening> registry;
+
+    struct chunk {
+        size_t begin, end;
+
+        // first pass
+        stack local;
+        int min_depth = 0x7fffffff;
+        registry scopes;
+
+        // second pass
+        stack incoming;
+        std::string output;
+        struct record { size_t offset, out_begin, out_end; bool context, tagged; };
+        std::vector<record> records;
+    };
+
+    void push( stack &st, int depth, size_t offset ) {
+        st.resize( depth + 1, npos );
+        st[ depth ] = offset;
+    }
+
+    // state after chunk = chunk's own entries, falling back to incoming entries not popped by the chunk
+    stack combine( const stack &incoming, const chunk &c ) {
+        if( c.local.empty() ) return incoming;
+        stack out( c.local );
+        for( int d = 0; d < c.min_depth && d < (int)out.size() && d < (int)incoming.size(); ++d ) {
+            if( out[d] == npos ) out[d] = incoming[d];
+        }
+        return out;
+    }
+
+    template<typename FN>
+    void for_each_line( const char *data, size_t begin, size_t end, FN &&fn ) {
+        for( size_t it = begin; it < end; ) {
+            const char *nl = (const char *)memchr( data + it, '\n', end - it );
+            size_t eol = nl ? size_t( nl - data ) : end;
+            fn( it, eol );
+            it = eol + 1;
+        }
+    }
+
+    void first_pass( const char *data, chunk &c ) {
+        parsed_line line;
+        for_each_line( data, c.begin, c.end, [&]( size_t b, size_t e ) {
+            head_of( data + b, data + e, line );
+            push( c.local, line.depth, b );
+            c.min_depth = std::min( c.min_depth, line.depth );
+            // first line entering a scope opens it (later ones re-enter it)
+            if( line.enters && !c.scopes.count( line.id ) ) c.scopes[ line.id ] = { b, line.parent };
+        } );
+    }
+
+    void second_pass( const char *data, size_t size, chunk &c, const registry &scopes, const query &q ) {
+        stack st( c.incoming );
+        parsed_line line, ctx;
+        std::string lower;
+        size_t last = npos; // latest offset emitted by this chunk
+        std::unordered_set<size_t> shown; // tagged context emitted by this chunk
+
+        auto emit = [&]( size_t offset, const parsed_line &pl, const std::string &lw, bool context, bool tagged ) {
+            size_t from = c.output.size();
+            q.render( c.output, pl, lw, context );
+            c.records.push_back( { offset, from, c.output.size(), context, tagged } );
+            if( last == npos || offset > last ) last = offset;
+        };
+        auto emit_context = [&]( size_t anc, bool tagged ) {
+            const char *nl = (const char *)memchr( data + anc, '\n', size - anc );
+            parse( data + anc, nl ? nl : data + size, ctx );
+            emit( anc, ctx, lowercase( ctx.plain ), true, tagged );
+        };
+
+        for_each_line( data, c.begin, c.end, [&]( size_t b, size_t e ) {
+            parse( data + b, data + e, line );
+            lower = lowercase( line.plain );
+            st.resize( line.depth, npos );
+            if( q.matches( lower, line.text ) ) {
+                if( line.tagged ) {
+                    // opening lines of parent scopes, outermost first. lines of other threads may sit in between
+                    std::vector<size_t> chain;
+                    unsigned id = line.id;
+                    for( auto it = scopes.find( id ); it != scopes.end() && chain.size() < 256; it = scopes.find( id ) ) {
+                        id = it->second.parent;
+                        auto up = scopes.find( id );
+                        if( !id || up == scopes.end() ) break;
+                        chain.push_back( up->second.offset );
+                    }
+                    for( auto anc = chain.rbegin(); anc != chain.rend(); ++anc ) {
+                        if( *anc != b && shown.insert( *anc ).second ) emit_context( *anc, true );
+                    }
+                } else {
+                    // depth 0 is the root gutter, not a scope; start from first nested level
+                    for( size_t d = 1; d < st.size(); ++d ) {
+                        size_t anc = st[d];
+                        if( anc == npos || ( last != npos && anc <= last ) ) continue;
+                        emit_context( anc, false );
+                    }
+                }
+                emit( b, line, lower, false, line.tagged );
+            }
+            push( st, line.depth, b );
+        } );
+    }
+}
+
+// -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8< -- 8<
+
+int main( int argc, const char **argv ) {
+    query q;
+    unsigned threads = std::max( 1u, std::thread::hardware_concurrency() );
+    q.colors = isatty( fileno( stdout ) ) != 0;
+
+    int arg = 1;
+    for( ; arg < argc && argv[arg][0] == '-'; ++arg ) {
+        std::string opt = argv[arg];
+        /**/ if( opt == "-p" ) q.colors = false;
+        else if( opt == "-j" && arg + 1 < argc ) threads = std::max( 1, atoi( argv[++arg] ) );
+        else if( opt.size() > 2 && opt.compare( 0, 2, "-j" ) == 0 ) threads = std::max( 1, atoi( &opt[2] ) );
+        else if( opt == "-c" && arg + 1 < argc ) {
+            std::string spec = argv[++arg];
+            size_t eq = spec.find( '=' );
+            int color = eq == std::string::npos ? -1 : color_by_name( lowercase( spec.substr( 0, eq ) ) );
+            if( color < 0 ) return fprintf( stderr, "drview: unknown color in '%s'\n", spec.c_str() ), 1;
+            std::string keywords = spec.substr( eq + 1 ) + ",";
+            for( size_t pos = 0, next; ( next = keywords.find( ',', pos ) ) != std::string::npos; pos = next + 1 ) {
+                if( next > pos ) q.highlights[ lowercase( keywords.substr( pos, next - pos ) ) ] = color;
+            }
+        }
+        else break;
+    }
+
+    if( arg >= argc ) {
+        fprintf( stderr, "usage: %s [-j threads] [-p] [-c color=keyword,keyword...] logfile [keyword...] [-keyword...]\n", argv[0] );
+        return 1;
+    }
+
+    const char *pathfile = argv[arg++];
+    for( ; arg < argc; ++arg ) {
+        std::string kw = lowercase( argv[arg] );
+        if( kw.size() > 1 && kw[0] == '-' ) q.negatives.push_back( kw.substr( 1 ) );
+        else if( !kw.empty() ) q.positives.push_back( kw );
+    }
+
+    mapped_file file;
+    if( !file.open( pathfile ) ) {
+        return fprintf( stderr, "drview: cannot map '%s'\n", pathfile ), 1;
+    }
+    const char *data = file.data;
+    const size_t size = file.size;
+
+    // split in chunks on line boundaries. a few chunks per core keeps cores busy on uneven chunks
+    const size_t min_chunk = 1 << 20;
+    size_t num_chunks = std::max<size_t>( 1, std::min<size_t>( threads * 8, size / min_chunk ) );
+    std::vector<chunk> chunks;
+    for( size_t i = 0, begin = 0; i < num_chunks && begin < size; ++i ) {
+        size_t end = ( i + 1 == num_chunks ) ? size : std::max( begin, size / num_chunks * ( i + 1 ) );
+        const char *nl = end < size ? (const char *)memchr( data + end, '\n', size - end ) : 0;
+        end = nl ? size_t( nl - data ) + 1 : size;
+        chunk c;
+        c.begin = begin, c.end = end;
+        chunks.push_back( c );
+        begin = end;
+    }
+
+    auto parallel = [&]( const std::function<void(chunk &)> &fn ) {
+        std::atomic<size_t> next( 0 );
+        std::vector<std::thread> pool;
+        for( unsigned t = 0; t < threads && t < chunks.size(); ++t ) {
+            pool.emplace_back( [&] {
+                for( size_t i; ( i = next++ ) < chunks.size(); ) fn( chunks[i] );
+            } );
+        }
+        for( auto &th : pool ) th.join();
+    };
+
+    // pass #1: per-chunk scope stacks, in parallel. then chain them to find each chunk's incoming stack
+    parallel( [&]( chunk &c ) { first_pass( data, c ); } );
+    stack st;
+    registry scopes;
+    for( auto &c : chunks ) {
+        c.incoming = st;
+        st = combine( st, c );
+        for( auto &entry : c.scopes ) scopes.insert( entry ); // earlier chunks win
+        registry().swap( c.scopes );
+    }
+
+    // pass #2: filter and render, in parallel
+    parallel( [&]( chunk &c ) { second_pass( data, size, c, scopes, q ); } );
+
+    // merge in order. context lines already printed by a previous chunk are skipped
+    size_t last = npos;
+    std::unordered_set<size_t> shown;
+    for( auto &c : chunks ) {
+        for( auto &r : c.records ) {
+            if( r.context && ( r.tagged ? !shown.insert( r.offset ).second : last != npos && r.offset <= last ) ) continue;
+            fwrite( c.output.data() + r.out_begin, 1, r.out_end - r.out_begin, stdout );
+            if( last == npos || r.offset > last ) last = r.offset;
+        }
+        std::string().swap( c.output );
+    }
+
+    return 0;
+}